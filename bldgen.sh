@@ -0,0 +1,10 @@
+files=$(find . -type f -name '*.c')
+flags=$(cat ./compile_flags.txt)
+genflags=$(grep -v -e '^-o$' -e '^\./aoc$' ./compile_flags.txt)
+
+# build the day 19 matcher generator, generate matchers for the current input,
+# and compile them in.
+clang src/days/day19.c libs/dynarr/dynarr.c libs/hashmap/hashmap.c \
+    libs/vector/vector.c $genflags -DDAY19_GEN -o ./day19gen &&
+    ./day19gen inputs/day19.txt src/days/day19_matchers.h &&
+    clang $files $flags -DDAY19_GENERATED
@@ -10,6 +10,10 @@
 #include <stddef.h>
 #include "hashmap.h"
 
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
 static void *(*_malloc)(size_t) = NULL;
 static void *(*_realloc)(void *, size_t) = NULL;
 static void (*_free)(void *) = NULL;
@@ -28,11 +32,26 @@ void hashmap_set_allocator(void *(*malloc)(size_t), void (*free)(void*))
     exit(1); \
 }
 
+// control bytes of the swiss backend; see SWISS TABLE BACKEND below.
+#define SWISS_GROUP 16
+#define SWISS_EMPTY 0x80
+#define SWISS_DELETED 0xFE
+
 struct bucket {
     uint64_t hash:48;
     uint64_t dib:16;
 };
 
+// how many of the new buckets each set or delete zeroes before an incremental
+// resize starts, and how many of the old buckets it moves after. both are
+// well over what's needed to finish before the buckets fill up.
+#ifndef HASHMAP_ZERO_STEP
+#define HASHMAP_ZERO_STEP 64
+#endif
+#ifndef HASHMAP_MIGRATE_STEP
+#define HASHMAP_MIGRATE_STEP 16
+#endif
+
 // hashmap is an open addressed hash map using robinhood hashing.
 struct hashmap {
     void *(*malloc)(size_t);
@@ -55,6 +74,18 @@ struct hashmap {
     void *buckets;
     void *spare;
     void *edata;
+    bool swiss;          // see SWISS TABLE BACKEND below
+    uint8_t *ctrl;       // swiss: one control byte per slot
+    char *items;         // swiss: the slots' items, after the control bytes
+    size_t tombstones;   // swiss: deleted slots that still end probes
+    bool incremental;    // see INCREMENTAL RESIZING below
+    void *new_buckets;   // the buckets being zeroed, or NULL
+    size_t zeroed;
+    void *old_buckets;   // the buckets being moved, or NULL
+    size_t old_nbuckets;
+    size_t old_mask;
+    uint64_t *old_stale; // one bit per old bucket, set once it's replaced
+    size_t migrated;     // the old buckets before this one have been moved
 };
 
 static struct bucket *bucket_at(struct hashmap *map, size_t index) {
@@ -65,23 +96,36 @@ static void *bucket_item(struct bucket *entry) {
     return ((char*)entry)+sizeof(struct bucket);
 }
 
-static uint64_t get_hash(struct hashmap *map, void *key) {
+static uint64_t get_hash(struct hashmap *map, const void *key) {
     return map->hash(key, map->seed0, map->seed1) << 16 >> 16;
 }
 
-// hashmap_new_with_allocator returns a new hash map using a custom allocator.
-// See hashmap_new for more information information
-struct hashmap *hashmap_new_with_allocator(
-                            void *(*_malloc)(size_t), 
-                            void *(*_realloc)(void*, size_t), 
-                            void (*_free)(void*),
-                            size_t elsize, size_t cap, 
-                            uint64_t seed0, uint64_t seed1,
-                            uint64_t (*hash)(const void *item, 
-                                             uint64_t seed0, uint64_t seed1),
-                            int (*compare)(const void *a, const void *b, 
-                                           void *udata),
-                            void *udata)
+static bool swiss_alloc(struct hashmap *map, size_t nbuckets);
+static bool swiss_resize(struct hashmap *map, size_t nbuckets);
+static void *swiss_get(struct hashmap *map, const void *key, uint64_t hash);
+static void *swiss_set(struct hashmap *map, void *item);
+static void *swiss_delete(struct hashmap *map, void *key);
+static void *swiss_item(struct hashmap *map, size_t slot);
+static bool grow_incrementally(struct hashmap *map);
+static void resize_step(struct hashmap *map);
+static void finish_resize(struct hashmap *map);
+static struct bucket *find_old(struct hashmap *map, const void *key, 
+                               uint64_t hash);
+static bool old_is_stale(struct hashmap *map, size_t index);
+static void mark_stale(struct hashmap *map, struct bucket *old);
+
+// new_map does the work of all the hashmap_new functions.
+static struct hashmap *new_map(enum hashmap_backend backend,
+                               void *(*_malloc)(size_t), 
+                               void *(*_realloc)(void*, size_t), 
+                               void (*_free)(void*),
+                               size_t elsize, size_t cap, 
+                               uint64_t seed0, uint64_t seed1,
+                               uint64_t (*hash)(const void *item, 
+                                                uint64_t seed0, uint64_t seed1),
+                               int (*compare)(const void *a, const void *b, 
+                                              void *udata),
+                               void *udata)
 {
     _malloc = _malloc ? _malloc : malloc;
     _realloc = _realloc ? _realloc : realloc;
@@ -116,6 +160,17 @@ struct hashmap *hashmap_new_with_allocator(
     map->spare = ((char*)map)+sizeof(struct hashmap);
     map->edata = (char*)map->spare+bucketsz;
     map->cap = cap;
+    map->malloc = _malloc;
+    map->realloc = _realloc;
+    map->free = _free;
+    if (backend == HASHMAP_SWISS) {
+        map->swiss = true;
+        if (!swiss_alloc(map, cap)) {
+            _free(map);
+            return NULL;
+        }
+        return map;
+    }
     map->nbuckets = cap;
     map->mask = map->nbuckets-1;
     map->buckets = _malloc(map->bucketsz*map->nbuckets);
@@ -126,12 +181,48 @@ struct hashmap *hashmap_new_with_allocator(
     memset(map->buckets, 0, map->bucketsz*map->nbuckets);
     map->growat = map->nbuckets*0.75;
     map->shrinkat = map->nbuckets*0.10;
-    map->malloc = _malloc;
-    map->realloc = _realloc;
-    map->free = _free;
     return map;  
 }
 
+// hashmap_new_with_allocator returns a new hash map using a custom allocator.
+// See hashmap_new for more information information
+struct hashmap *hashmap_new_with_allocator(
+                            void *(*_malloc)(size_t), 
+                            void *(*_realloc)(void*, size_t), 
+                            void (*_free)(void*),
+                            size_t elsize, size_t cap, 
+                            uint64_t seed0, uint64_t seed1,
+                            uint64_t (*hash)(const void *item, 
+                                             uint64_t seed0, uint64_t seed1),
+                            int (*compare)(const void *a, const void *b, 
+                                           void *udata),
+                            void *udata)
+{
+    return new_map(HASHMAP_ROBINHOOD, _malloc, _realloc, _free, elsize, cap, 
+                   seed0, seed1, hash, compare, udata);
+}
+
+// hashmap_new_with_backend returns a new hash map that uses the given
+// backend. HASHMAP_ROBINHOOD is what hashmap_new uses. HASHMAP_SWISS keeps
+// a byte of each item's hash in a separate array, which is probed 16 slots
+// at a time, and lets the map fill up to 7/8 instead of 3/4 before growing.
+// See hashmap_new for the other params.
+struct hashmap *hashmap_new_with_backend(enum hashmap_backend backend,
+                            size_t elsize, size_t cap, 
+                            uint64_t seed0, uint64_t seed1,
+                            uint64_t (*hash)(const void *item, 
+                                             uint64_t seed0, uint64_t seed1),
+                            int (*compare)(const void *a, const void *b, 
+                                           void *udata),
+                            void *udata)
+{
+    return new_map(backend, 
+                   (_malloc?_malloc:malloc),
+                   (_realloc?_realloc:realloc),
+                   (_free?_free:free),
+                   elsize, cap, seed0, seed1, hash, compare, udata);
+}
+
 
 // hashmap_new returns a new hash map. 
 // Param `elsize` is the size of each element in the tree. Every element that
@@ -144,7 +235,9 @@ struct hashmap *hashmap_new_with_allocator(
 // Param `hash` is a function that generates a hash value for an item. It's
 // important that you provide a good hash function, otherwise it will perform
 // poorly or be vulnerable to Denial-of-service attacks. This implementation
-// comes with two helper functions `hashmap_sip()` and `hashmap_murmur()`.
+// comes with the helper functions `hashmap_sip()`, `hashmap_murmur()` and
+// `hashmap_wyhash()`, and with the `hashmap_mix*()` integer mixers in
+// hashmap.h.
 // Param `compare` is a function that compares items in the tree. See the 
 // qsort stdlib function for an example of how this function works.
 // The hashmap must be freed with hashmap_free(). 
@@ -170,6 +263,26 @@ struct hashmap *hashmap_new(size_t elsize, size_t cap,
 // that this operation does not perform any allocations.
 void hashmap_clear(struct hashmap *map, bool update_cap) {
     map->count = 0;
+    if (map->swiss) {
+        if (update_cap) {
+            map->cap = map->nbuckets;
+        } else if (map->nbuckets != map->cap) {
+            // on failure, the old slots are kept (and emptied below).
+            void *old = map->buckets;
+            if (swiss_alloc(map, map->cap)) {
+                map->free(old);
+            }
+        }
+        memset(map->ctrl, SWISS_EMPTY, map->nbuckets);
+        map->tombstones = 0;
+        return;
+    }
+    map->free(map->new_buckets);
+    map->new_buckets = NULL;
+    map->free(map->old_buckets);
+    map->old_buckets = NULL;
+    map->free(map->old_stale);
+    map->old_stale = NULL;
     if (update_cap) {
         map->cap = map->nbuckets;
     } else if (map->nbuckets != map->cap) {
@@ -234,9 +347,15 @@ void *hashmap_set(struct hashmap *map, void *item) {
     if (!item) {
         panic("item is null");
     }
+    if (map->swiss) {
+        return swiss_set(map, item);
+    }
     map->oom = false;
-    if (map->count == map->growat) {
-        if (!resize(map, map->nbuckets*2)) {
+    resize_step(map);
+    if (map->count >= map->growat) {
+        if (!(map->incremental ? grow_incrementally(map) 
+                               : resize(map, map->nbuckets*2)))
+        {
             map->oom = true;
             return NULL;
         }
@@ -247,12 +366,23 @@ void *hashmap_set(struct hashmap *map, void *item) {
     entry->hash = get_hash(map, item);
     entry->dib = 1;
     memcpy(bucket_item(entry), item, map->elsize);
+    // an item that's still in the old buckets is replaced by moving the new
+    // one to the new buckets.
+    struct bucket *old = NULL;
+    if (map->old_buckets) {
+        old = find_old(map, item, entry->hash);
+    }
     
     size_t i = entry->hash & map->mask;
 	for (;;) {
         struct bucket *bucket = bucket_at(map, i);
         if (bucket->dib == 0) {
             memcpy(bucket, entry, map->bucketsz);
+            if (old) {
+                memcpy(map->spare, bucket_item(old), map->elsize);
+                mark_stale(map, old);
+                return map->spare;
+            }
             map->count++;
 			return NULL;
 		}
@@ -274,17 +404,18 @@ void *hashmap_set(struct hashmap *map, void *item) {
 	}
 }
 
-// hashmap_get returns the item based on the provided key. If the item is not
-// found then NULL is returned.
-void *hashmap_get(struct hashmap *map, void *key) {
-    if (!key) {
-        panic("key is null");
-    }
-    uint64_t hash = get_hash(map, key);
+// get_with_hash probes for a key whose hash has already been computed.
+static void *get_with_hash(struct hashmap *map, const void *key, 
+                           uint64_t hash)
+{
 	size_t i = hash & map->mask;
 	for (;;) {
         struct bucket *bucket = bucket_at(map, i);
 		if (!bucket->dib) {
+            if (map->old_buckets) {
+                struct bucket *old = find_old(map, key, hash);
+                return old ? bucket_item(old) : NULL;
+            }
 			return NULL;
 		}
 		if (bucket->hash == hash && 
@@ -296,11 +427,77 @@ void *hashmap_get(struct hashmap *map, void *key) {
 	}
 }
 
+// hashmap_get returns the item based on the provided key. If the item is not
+// found then NULL is returned.
+void *hashmap_get(struct hashmap *map, void *key) {
+    if (!key) {
+        panic("key is null");
+    }
+    if (map->swiss) {
+        return swiss_get(map, key, get_hash(map, key));
+    }
+    return get_with_hash(map, key, get_hash(map, key));
+}
+
+#ifndef HASHMAP_BATCH
+#define HASHMAP_BATCH 16
+#endif
+
+#if defined(__GNUC__) || defined(__clang__)
+#define prefetch(_addr_) __builtin_prefetch(_addr_)
+#else
+#define prefetch(_addr_) ((void)(_addr_))
+#endif
+
+// hashmap_get_many looks up the `n` keys stored one after another in `keys`,
+// each `elsize` bytes long. The found items (or NULL) are stored in `found`,
+// which may be NULL when only the count is needed. Returns how many of the
+// keys were found.
+// The keys are handled in batches: every hash of a batch is computed and its
+// bucket prefetched before any of them is probed, so that the cache misses
+// of independent lookups overlap instead of following one another.
+size_t hashmap_get_many(struct hashmap *map, const void *keys, size_t n, 
+                        void **found)
+{
+    if (!keys && n > 0) {
+        panic("keys are null");
+    }
+    size_t count = 0;
+    uint64_t hashes[HASHMAP_BATCH];
+    for (size_t start = 0; start < n; start += HASHMAP_BATCH) {
+        size_t len = n-start < HASHMAP_BATCH ? n-start : HASHMAP_BATCH;
+        const char *batch = (const char*)keys+start*map->elsize;
+        for (size_t i = 0; i < len; i++) {
+            hashes[i] = get_hash(map, batch+i*map->elsize);
+            if (map->swiss) {
+                size_t ngroups = map->nbuckets/SWISS_GROUP;
+                prefetch(map->ctrl+((hashes[i]>>7)&(ngroups-1))*SWISS_GROUP);
+            } else {
+                prefetch(bucket_at(map, hashes[i] & map->mask));
+            }
+        }
+        for (size_t i = 0; i < len; i++) {
+            const void *key = batch+i*map->elsize;
+            void *item = map->swiss ? swiss_get(map, key, hashes[i]) 
+                                    : get_with_hash(map, key, hashes[i]);
+            count += item != NULL;
+            if (found) {
+                found[start+i] = item;
+            }
+        }
+    }
+    return count;
+}
+
 // hashmap_probe returns the item in the bucket at position or NULL if an item
 // is not set for that bucket. The position is 'moduloed' by the number of 
-// buckets in the hashmap.
+// buckets in the hashmap. An incremental resize is finished first.
 void *hashmap_probe(struct hashmap *map, uint64_t position) {
+    finish_resize(map);
     size_t i = position & map->mask;
+    if (map->swiss) {
+        return map->ctrl[i]&0x80 ? NULL : swiss_item(map, i);
+    }
     struct bucket *bucket = bucket_at(map, i);
     if (!bucket->dib) {
 		return NULL;
@@ -315,13 +512,27 @@ void *hashmap_delete(struct hashmap *map, void *key) {
     if (!key) {
         panic("key is null");
     }
+    if (map->swiss) {
+        return swiss_delete(map, key);
+    }
     map->oom = false;
+    resize_step(map);
     uint64_t hash = get_hash(map, key);
 	size_t i = hash & map->mask;
 	for (;;) {
         struct bucket *bucket = bucket_at(map, i);
 		if (!bucket->dib) {
-			return NULL;
+            struct bucket *old = NULL;
+            if (map->old_buckets) {
+                old = find_old(map, key, hash);
+            }
+            if (!old) {
+                return NULL;
+            }
+            memcpy(map->spare, bucket_item(old), map->elsize);
+            mark_stale(map, old);
+            map->count--;
+            return map->spare;
 		}
 		if (bucket->hash == hash && 
             map->compare(key, bucket_item(bucket), map->udata) == 0)
@@ -340,7 +551,9 @@ void *hashmap_delete(struct hashmap *map, void *key) {
                 prev->dib--;
             }
             map->count--;
-            if (map->nbuckets > map->cap && map->count <= map->shrinkat) {
+            if (map->nbuckets > map->cap && map->count <= map->shrinkat && 
+                !map->new_buckets && !map->old_buckets) 
+            {
                 // Ignore the return value. It's ok for the resize operation to
                 // fail to allocate enough memory because a shrink operation
                 // does not change the integrity of the data.
@@ -361,6 +574,9 @@ size_t hashmap_count(struct hashmap *map) {
 void hashmap_free(struct hashmap *map) {
     if (!map) return;
     map->free(map->buckets);
+    map->free(map->new_buckets);
+    map->free(map->old_buckets);
+    map->free(map->old_stale);
     map->free(map);
 }
 
@@ -376,6 +592,14 @@ bool hashmap_oom(struct hashmap *map) {
 bool hashmap_scan(struct hashmap *map, 
                   bool (*iter)(const void *item, void *udata), void *udata)
 {
+    if (map->swiss) {
+        for (size_t i = 0; i < map->nbuckets; i++) {
+            if (!(map->ctrl[i]&0x80) && !iter(swiss_item(map, i), udata)) {
+                return false;
+            }
+        }
+        return true;
+    }
     for (size_t i = 0; i < map->nbuckets; i++) {
         struct bucket *bucket = bucket_at(map, i);
         if (bucket->dib) {
@@ -384,9 +608,427 @@ bool hashmap_scan(struct hashmap *map,
             }
         }
     }
+    for (size_t i = map->migrated; map->old_buckets && i < map->old_nbuckets; 
+         i++) 
+    {
+        struct bucket *bucket = (struct bucket*)
+            ((char*)map->old_buckets+map->bucketsz*i);
+        if (bucket->dib && !old_is_stale(map, i)) {
+            if (!iter(bucket_item(bucket), udata)) {
+                return false;
+            }
+        }
+    }
     return true;
 }
 
+//-----------------------------------------------------------------------------
+// INCREMENTAL RESIZING
+//
+// With hashmap_incremental(), a robinhood map that needs to grow doesn't move
+// everything at once. It allocates twice as many buckets, and each following
+// set or delete zeroes HASHMAP_ZERO_STEP of them, meanwhile the items keep
+// going into the old buckets, a bit past the usual 3/4. Once they're zeroed
+// the new buckets are swapped in, and each set or delete moves
+// HASHMAP_MIGRATE_STEP of the old buckets, in order. Until they're all moved,
+// lookups that miss in the new buckets also look in the old ones.
+// The old buckets are never shifted around, so that the probes through them
+// keep working. Their items are only marked as stale once they've been
+// replaced or deleted, in a bitmap next to them so that the stored hashes
+// keep all their bits, and the ones before `migrated` are skipped, since
+// they have already been moved.
+//-----------------------------------------------------------------------------
+
+static void zero(struct hashmap *map, size_t nbuckets);
+static void migrate(struct hashmap *map, size_t nbuckets);
+
+// hashmap_incremental turns incremental resizing on or off for a robinhood
+// map (the swiss backend ignores it). When turned off, a resize that's in
+// progress is finished.
+void hashmap_incremental(struct hashmap *map, bool incremental) {
+    map->incremental = incremental && !map->swiss;
+    if (!map->incremental) {
+        finish_resize(map);
+    }
+}
+
+static struct bucket *old_bucket_at(struct hashmap *map, size_t index) {
+    return (struct bucket*)(((char*)map->old_buckets)+(map->bucketsz*index));
+}
+
+static bool old_is_stale(struct hashmap *map, size_t index) {
+    return map->old_stale[index/64] >> (index%64) & 1;
+}
+
+static void mark_stale(struct hashmap *map, struct bucket *old) {
+    size_t index = ((char*)old-(char*)map->old_buckets)/map->bucketsz;
+    map->old_stale[index/64] |= (uint64_t)1 << (index%64);
+}
+
+// stale_words is the size of the stale bitmap for `nbuckets` old buckets.
+static size_t stale_words(size_t nbuckets) {
+    return (nbuckets+63)/64;
+}
+
+// grow_incrementally is called by a set that finds the map full. It starts a
+// resize, unless one is already zeroing, in which case the map can take some
+// more items. Returns false if the memory couldn't be allocated.
+static bool grow_incrementally(struct hashmap *map) {
+    if (map->new_buckets) {
+        if (map->count >= map->nbuckets-map->nbuckets/8) {
+            zero(map, map->nbuckets*2);
+        }
+        return true;
+    }
+    if (map->old_buckets) {
+        migrate(map, map->old_nbuckets);
+    }
+    map->new_buckets = map->malloc(map->bucketsz*map->nbuckets*2);
+    if (!map->new_buckets) {
+        return false;
+    }
+    map->old_stale = map->malloc(sizeof(uint64_t)*stale_words(map->nbuckets));
+    if (!map->old_stale) {
+        map->free(map->new_buckets);
+        map->new_buckets = NULL;
+        return false;
+    }
+    map->zeroed = 0;
+    return true;
+}
+
+// resize_step does a bounded part of an incremental resize, if there is one.
+static void resize_step(struct hashmap *map) {
+    if (map->new_buckets) {
+        zero(map, HASHMAP_ZERO_STEP);
+    } else if (map->old_buckets) {
+        migrate(map, HASHMAP_MIGRATE_STEP);
+    }
+}
+
+static void finish_resize(struct hashmap *map) {
+    if (map->new_buckets) {
+        zero(map, map->nbuckets*2);
+    }
+    if (map->old_buckets) {
+        migrate(map, map->old_nbuckets);
+    }
+}
+
+// zero zeroes up to `nbuckets` of the new buckets, and the same share of the
+// stale bitmap, and swaps them in once they're all zeroed.
+static void zero(struct hashmap *map, size_t nbuckets) {
+    size_t total = map->nbuckets*2;
+    size_t end = nbuckets < total-map->zeroed ? map->zeroed+nbuckets : total;
+    memset((char*)map->new_buckets+map->bucketsz*map->zeroed, 0, 
+           map->bucketsz*(end-map->zeroed));
+    size_t words = stale_words(map->nbuckets);
+    memset(map->old_stale+map->zeroed*words/total, 0, 
+           sizeof(uint64_t)*(end*words/total-map->zeroed*words/total));
+    map->zeroed = end;
+    if (end < total) {
+        return;
+    }
+    map->old_buckets = map->buckets;
+    map->old_nbuckets = map->nbuckets;
+    map->old_mask = map->mask;
+    map->migrated = 0;
+    map->buckets = map->new_buckets;
+    map->new_buckets = NULL;
+    map->nbuckets = total;
+    map->mask = total-1;
+    map->growat = map->nbuckets*0.75;
+    map->shrinkat = map->nbuckets*0.10;
+}
+
+// migrate moves up to `nbuckets` of the old buckets to the new ones, and
+// frees the old buckets once they've all been moved.
+static void migrate(struct hashmap *map, size_t nbuckets) {
+    size_t end = map->migrated+nbuckets;
+    if (end > map->old_nbuckets || end < map->migrated) {
+        end = map->old_nbuckets;
+    }
+    struct bucket *entry = map->edata;
+    for (; map->migrated < end; map->migrated++) {
+        struct bucket *old = old_bucket_at(map, map->migrated);
+        if (!old->dib || old_is_stale(map, map->migrated)) {
+            continue;
+        }
+        // none of the old items are in the new buckets yet.
+        memcpy(entry, old, map->bucketsz);
+        entry->dib = 1;
+        size_t i = entry->hash & map->mask;
+        for (;;) {
+            struct bucket *bucket = bucket_at(map, i);
+            if (bucket->dib == 0) {
+                memcpy(bucket, entry, map->bucketsz);
+                break;
+            }
+            if (bucket->dib < entry->dib) {
+                memcpy(map->spare, bucket, map->bucketsz);
+                memcpy(bucket, entry, map->bucketsz);
+                memcpy(entry, map->spare, map->bucketsz);
+            }
+            i = (i + 1) & map->mask;
+            entry->dib += 1;
+        }
+    }
+    if (map->migrated == map->old_nbuckets) {
+        map->free(map->old_buckets);
+        map->old_buckets = NULL;
+        map->free(map->old_stale);
+        map->old_stale = NULL;
+    }
+}
+
+// find_old returns the old bucket that holds the key, unless it has already 
+// been moved, replaced or deleted.
+static struct bucket *find_old(struct hashmap *map, const void *key, 
+                               uint64_t hash)
+{
+    size_t i = hash & map->old_mask;
+    for (;;) {
+        struct bucket *bucket = old_bucket_at(map, i);
+        if (!bucket->dib) {
+            return NULL;
+        }
+        if (bucket->hash == hash && 
+            map->compare(key, bucket_item(bucket), map->udata) == 0)
+        {
+            return old_is_stale(map, i) || i < map->migrated ? NULL : bucket;
+        }
+        i = (i + 1) & map->old_mask;
+    }
+}
+
+// hashmap_reserve makes room for `count` items, so that the map doesn't grow
+// until it holds more than that. The map also won't shrink below that size.
+// Returns false if the memory couldn't be allocated.
+bool hashmap_reserve(struct hashmap *map, size_t count) {
+    size_t nbuckets = map->nbuckets;
+    if (map->swiss) {
+        while (nbuckets-nbuckets/8 < count) {
+            nbuckets *= 2;
+        }
+        if (nbuckets > map->nbuckets && !swiss_resize(map, nbuckets)) {
+            return false;
+        }
+    } else {
+        finish_resize(map);
+        nbuckets = map->nbuckets;
+        while ((size_t)(nbuckets*0.75) < count) {
+            nbuckets *= 2;
+        }
+        if (nbuckets > map->nbuckets && !resize(map, nbuckets)) {
+            return false;
+        }
+    }
+    if (map->cap < nbuckets) {
+        map->cap = nbuckets;
+    }
+    return true;
+}
+
+//-----------------------------------------------------------------------------
+// SWISS TABLE BACKEND
+//
+// The slots are split into groups of 16. Each slot has a control byte, which
+// is SWISS_EMPTY, SWISS_DELETED, or the low 7 bits of its item's hash; the
+// control bytes are kept together, ahead of the items. A lookup picks a group
+// from the rest of the hash, and compares all 16 control bytes of the group
+// with the key's 7 bits at once, only looking at the items that match. It
+// moves on to other groups until it reaches a group with an empty slot.
+//-----------------------------------------------------------------------------
+
+// swiss_match returns a bit for every control byte of the group that's equal
+// to `byte`.
+static uint32_t swiss_match(const uint8_t *group, uint8_t byte) {
+#ifdef __SSE2__
+    __m128i ctrl = _mm_loadu_si128((const __m128i*)group);
+    return _mm_movemask_epi8(_mm_cmpeq_epi8(ctrl, _mm_set1_epi8(byte)));
+#else
+    uint32_t mask = 0;
+    for (int i = 0; i < SWISS_GROUP; i++) {
+        mask |= (uint32_t)(group[i] == byte) << i;
+    }
+    return mask;
+#endif
+}
+
+// swiss_match_free returns a bit for every slot of the group that's empty or
+// deleted, which are the control bytes with their high bit set.
+static uint32_t swiss_match_free(const uint8_t *group) {
+#ifdef __SSE2__
+    return _mm_movemask_epi8(_mm_loadu_si128((const __m128i*)group));
+#else
+    uint32_t mask = 0;
+    for (int i = 0; i < SWISS_GROUP; i++) {
+        mask |= (uint32_t)(group[i] >> 7) << i;
+    }
+    return mask;
+#endif
+}
+
+static int lowest_bit(uint32_t mask) {
+#if defined(__GNUC__) || defined(__clang__)
+    return __builtin_ctz(mask);
+#else
+    int i = 0;
+    while (!(mask & 1)) {
+        mask >>= 1;
+        i++;
+    }
+    return i;
+#endif
+}
+
+static void *swiss_item(struct hashmap *map, size_t slot) {
+    return map->items+map->elsize*slot;
+}
+
+// swiss_alloc gives the map `nbuckets` empty slots, in one allocation.
+static bool swiss_alloc(struct hashmap *map, size_t nbuckets) {
+    uint8_t *block = map->malloc(nbuckets+map->elsize*nbuckets);
+    if (!block) {
+        return false;
+    }
+    memset(block, SWISS_EMPTY, nbuckets);
+    map->buckets = block;
+    map->ctrl = block;
+    map->items = (char*)block+nbuckets;
+    map->nbuckets = nbuckets;
+    map->mask = nbuckets-1;
+    map->growat = nbuckets-nbuckets/8;
+    map->shrinkat = nbuckets*0.10;
+    map->tombstones = 0;
+    return true;
+}
+
+// swiss_find returns the slot that holds the key, or -1. The groups are
+// probed in triangular order, which visits all of them.
+static int64_t swiss_find(struct hashmap *map, const void *key, 
+                          uint64_t hash)
+{
+    size_t ngroups = map->nbuckets/SWISS_GROUP;
+    size_t g = (hash>>7)&(ngroups-1);
+    for (size_t step = 1;; step++) {
+        const uint8_t *group = map->ctrl+g*SWISS_GROUP;
+        uint32_t mask = swiss_match(group, hash&0x7F);
+        while (mask) {
+            size_t slot = g*SWISS_GROUP+lowest_bit(mask);
+            if (map->compare(key, swiss_item(map, slot), map->udata) == 0) {
+                return slot;
+            }
+            mask &= mask-1;
+        }
+        if (swiss_match(group, SWISS_EMPTY)) {
+            return -1;
+        }
+        g = (g+step)&(ngroups-1);
+    }
+}
+
+// swiss_insert puts an item that isn't in the map yet in the first free slot
+// of its probe sequence.
+static void swiss_insert(struct hashmap *map, const void *item, 
+                         uint64_t hash)
+{
+    size_t ngroups = map->nbuckets/SWISS_GROUP;
+    size_t g = (hash>>7)&(ngroups-1);
+    for (size_t step = 1;; step++) {
+        uint32_t mask = swiss_match_free(map->ctrl+g*SWISS_GROUP);
+        if (mask) {
+            size_t slot = g*SWISS_GROUP+lowest_bit(mask);
+            if (map->ctrl[slot] == SWISS_DELETED) {
+                map->tombstones--;
+            }
+            map->ctrl[slot] = hash&0x7F;
+            memcpy(swiss_item(map, slot), item, map->elsize);
+            map->count++;
+            return;
+        }
+        g = (g+step)&(ngroups-1);
+    }
+}
+
+// swiss_resize moves every item to a new array of `nbuckets` slots, which
+// also drops the tombstones.
+static bool swiss_resize(struct hashmap *map, size_t nbuckets) {
+    void *old = map->buckets;
+    uint8_t *old_ctrl = map->ctrl;
+    char *old_items = map->items;
+    size_t old_nbuckets = map->nbuckets;
+    if (!swiss_alloc(map, nbuckets)) {
+        return false;
+    }
+    map->count = 0;
+    for (size_t i = 0; i < old_nbuckets; i++) {
+        if (!(old_ctrl[i]&0x80)) {
+            void *item = old_items+map->elsize*i;
+            swiss_insert(map, item, get_hash(map, item));
+        }
+    }
+    map->free(old);
+    return true;
+}
+
+static void *swiss_get(struct hashmap *map, const void *key, uint64_t hash) {
+    int64_t slot = swiss_find(map, key, hash);
+    return slot < 0 ? NULL : swiss_item(map, slot);
+}
+
+static void *swiss_set(struct hashmap *map, void *item) {
+    map->oom = false;
+    uint64_t hash = get_hash(map, item);
+    int64_t slot = swiss_find(map, item, hash);
+    if (slot >= 0) {
+        memcpy(map->spare, swiss_item(map, slot), map->elsize);
+        memcpy(swiss_item(map, slot), item, map->elsize);
+        return map->spare;
+    }
+    if (map->count+map->tombstones >= map->growat) {
+        // tombstones alone are cleared by rehashing in place.
+        size_t nbuckets = map->count >= map->growat/2 ? map->nbuckets*2 
+                                                      : map->nbuckets;
+        // without memory, a free slot can still be used, as long as an empty
+        // one is left to end the probes.
+        if (!swiss_resize(map, nbuckets) && 
+            (map->count >= map->growat || 
+             map->nbuckets-map->count-map->tombstones < 2))
+        {
+            map->oom = true;
+            return NULL;
+        }
+    }
+    swiss_insert(map, item, hash);
+    return NULL;
+}
+
+static void *swiss_delete(struct hashmap *map, void *key) {
+    map->oom = false;
+    int64_t slot = swiss_find(map, key, get_hash(map, key));
+    if (slot < 0) {
+        return NULL;
+    }
+    memcpy(map->spare, swiss_item(map, slot), map->elsize);
+    // a lookup stops at the first group with an empty slot, so the slot can
+    // only become empty if its group already has one. otherwise, it would
+    // cut off the items that were pushed past the group.
+    const uint8_t *group = map->ctrl+slot/SWISS_GROUP*SWISS_GROUP;
+    if (swiss_match(group, SWISS_EMPTY)) {
+        map->ctrl[slot] = SWISS_EMPTY;
+    } else {
+        map->ctrl[slot] = SWISS_DELETED;
+        map->tombstones++;
+    }
+    map->count--;
+    if (map->nbuckets > map->cap && map->count <= map->shrinkat) {
+        // as with the robinhood map, a failed shrink loses nothing.
+        swiss_resize(map, map->nbuckets/2);
+    }
+    return map->spare;
+}
+
 //-----------------------------------------------------------------------------
 // SipHash reference C implementation
 //
@@ -554,6 +1196,104 @@ uint64_t hashmap_murmur(const void *data, size_t len,
     return *(uint64_t*)out;
 }
 
+//-----------------------------------------------------------------------------
+// wyhash (final version 4) by Wang Yi, released into the public domain.
+// https://github.com/wangyi-fudan/wyhash
+//-----------------------------------------------------------------------------
+
+static const uint64_t _wyp[4] = {
+    0x2d358dccaa6c78a5ull, 0x8bb84b93962eacc9ull, 
+    0x4b33a62ed433d4a3ull, 0x4d5a2da51de1aa47ull,
+};
+
+static inline void _wymum(uint64_t *A, uint64_t *B) {
+#ifdef __SIZEOF_INT128__
+    __extension__ typedef unsigned __int128 u128;
+    u128 r = *A;
+    r *= *B;
+    *A = (uint64_t)r;
+    *B = (uint64_t)(r >> 64);
+#else
+    uint64_t ha = *A>>32, hb = *B>>32, la = (uint32_t)*A, lb = (uint32_t)*B;
+    uint64_t rh = ha*hb, rm0 = ha*lb, rm1 = hb*la, rl = la*lb;
+    uint64_t t = rl+(rm0<<32), c = t<rl, lo = t+(rm1<<32);
+    c += lo<t;
+    *A = lo;
+    *B = rh+(rm0>>32)+(rm1>>32)+c;
+#endif
+}
+
+static inline uint64_t _wymix(uint64_t A, uint64_t B) {
+    _wymum(&A, &B);
+    return A^B;
+}
+
+static inline uint64_t _wyr8(const uint8_t *p) {
+    uint64_t v;
+    memcpy(&v, p, 8);
+    return v;
+}
+
+static inline uint64_t _wyr4(const uint8_t *p) {
+    uint32_t v;
+    memcpy(&v, p, 4);
+    return v;
+}
+
+static inline uint64_t _wyr3(const uint8_t *p, size_t k) {
+    return (((uint64_t)p[0])<<16)|(((uint64_t)p[k>>1])<<8)|p[k-1];
+}
+
+static uint64_t wyhash(const void *key, size_t len, uint64_t seed) {
+    const uint8_t *p = (const uint8_t *)key;
+    seed ^= _wymix(seed^_wyp[0], _wyp[1]);
+    uint64_t a, b;
+    if (len <= 16) {
+        if (len >= 4) {
+            a = (_wyr4(p)<<32)|_wyr4(p+((len>>3)<<2));
+            b = (_wyr4(p+len-4)<<32)|_wyr4(p+len-4-((len>>3)<<2));
+        } else if (len > 0) {
+            a = _wyr3(p, len);
+            b = 0;
+        } else {
+            a = b = 0;
+        }
+    } else {
+        size_t i = len;
+        if (i > 48) {
+            uint64_t see1 = seed, see2 = seed;
+            do {
+                seed = _wymix(_wyr8(p)^_wyp[1], _wyr8(p+8)^seed);
+                see1 = _wymix(_wyr8(p+16)^_wyp[2], _wyr8(p+24)^see1);
+                see2 = _wymix(_wyr8(p+32)^_wyp[3], _wyr8(p+40)^see2);
+                p += 48;
+                i -= 48;
+            } while (i > 48);
+            seed ^= see1^see2;
+        }
+        while (i > 16) {
+            seed = _wymix(_wyr8(p)^_wyp[1], _wyr8(p+8)^seed);
+            i -= 16;
+            p += 16;
+        }
+        a = _wyr8(p+i-16);
+        b = _wyr8(p+i-8);
+    }
+    a ^= _wyp[1];
+    b ^= seed;
+    _wymum(&a, &b);
+    return _wymix(a^_wyp[0]^len, b^_wyp[1]);
+}
+
+// hashmap_wyhash returns a hash value for `data` using wyhash. It's several 
+// times faster than hashmap_sip(), but it isn't meant to resist attacks, so 
+// it's best kept to trusted inputs.
+uint64_t hashmap_wyhash(const void *data, size_t len, 
+                        uint64_t seed0, uint64_t seed1)
+{
+    return wyhash(data, len, seed0^_wymix(seed1^_wyp[2], _wyp[3]));
+}
+
 //==============================================================================
 // TESTS AND BENCHMARKS
 // $ cc -DHASHMAP_TEST hashmap.c && ./a.out              # run tests
@@ -564,13 +1304,26 @@ uint64_t hashmap_murmur(const void *data, size_t len,
 static size_t deepcount(struct hashmap *map) {
     size_t count = 0;
     for (size_t i = 0; i < map->nbuckets; i++) {
-        if (bucket_at(map, i)->dib) {
+        if (map->swiss ? !(map->ctrl[i]&0x80) : bucket_at(map, i)->dib) {
+            count++;
+        }
+    }
+    for (size_t i = map->migrated; map->old_buckets && i < map->old_nbuckets; 
+         i++) 
+    {
+        struct bucket *bucket = old_bucket_at(map, i);
+        if (bucket->dib && !old_is_stale(map, i)) {
             count++;
         }
     }
     return count;
 }
 
+// the backend that all() and test_get_many() test, and whether they resize
+// incrementally.
+static enum hashmap_backend test_backend = HASHMAP_ROBINHOOD;
+static bool test_incremental = false;
+
 
 #pragma GCC diagnostic ignored "-Wextra"
 
@@ -636,6 +1389,155 @@ static uint64_t hash_int(const void *item, uint64_t seed0, uint64_t seed1) {
     return hashmap_murmur(item, sizeof(int), seed0, seed1);
 }
 
+static int compare_u64s(const void *a, const void *b) {
+    uint64_t x = *(uint64_t*)a, y = *(uint64_t*)b;
+    return (x > y) - (x < y);
+}
+
+// check_hashes checks that no two of the hashes are equal, and that their
+// low bits, which pick the bucket, are spread evenly.
+static void check_hashes(const char *name, uint64_t *hashes, int n) {
+    int nbuckets = n / 16;
+    int *counts;
+    while (!(counts = xmalloc(nbuckets * sizeof(int)))) {}
+    memset(counts, 0, nbuckets * sizeof(int));
+    int max = 0;
+    for (int i = 0; i < n; i++) {
+        int count = ++counts[hashes[i] & (nbuckets - 1)];
+        max = count > max ? count : max;
+    }
+    xfree(counts);
+    qsort(hashes, n, sizeof(uint64_t), compare_u64s);
+    int collisions = 0;
+    for (int i = 1; i < n; i++) {
+        collisions += hashes[i] == hashes[i-1];
+    }
+    if (collisions > 0 || max > 48) {
+        fprintf(stderr, "%s: %d collisions, %d items in the fullest bucket "
+                "(16 expected)\n", name, collisions, max);
+        exit(1);
+    }
+}
+
+// test_hash_quality hashes keys that differ in only a few bits, like the 
+// points and indexes that hashmaps tend to be used with.
+static void test_hash_quality() {
+    int n = 1 << 18;
+    uint64_t *hashes;
+    while (!(hashes = xmalloc(n * sizeof(uint64_t)))) {}
+
+    for (int i = 0; i < n; i++) {
+        uint32_t key = i;
+        hashes[i] = hashmap_wyhash(&key, sizeof(key), 0, 0);
+    }
+    check_hashes("wyhash (4 bytes)", hashes, n);
+    for (int i = 0; i < n; i++) {
+        hashes[i] = hashmap_mix32(i, 0);
+    }
+    check_hashes("mix32", hashes, n);
+    for (int i = 0; i < n; i++) {
+        hashes[i] = hashmap_mix32((uint32_t)i << 13, 0);
+    }
+    check_hashes("mix32 (high bits)", hashes, n);
+
+    // a 512x512 grid of (x, y) pairs, and the same keys in the high bits.
+    for (int i = 0; i < n; i++) {
+        uint64_t key = (uint64_t)(i & 511) | (uint64_t)(i >> 9) << 32;
+        hashes[i] = hashmap_mix64(key, 0);
+    }
+    check_hashes("mix64", hashes, n);
+    for (int i = 0; i < n; i++) {
+        hashes[i] = hashmap_mix64((uint64_t)i << 40, 0);
+    }
+    check_hashes("mix64 (high bits)", hashes, n);
+    for (int i = 0; i < n; i++) {
+        uint64_t key = (uint64_t)(i & 511) | (uint64_t)(i >> 9) << 32;
+        hashes[i] = hashmap_wyhash(&key, sizeof(key), 0, 0);
+    }
+    check_hashes("wyhash (8 bytes)", hashes, n);
+
+    // 4-d points around the origin, 16x16x32x32.
+    for (int i = 0; i < n; i++) {
+        int32_t p[4] = {(i & 15) - 8, (i >> 4 & 15) - 8, (i >> 8 & 31) - 16,
+                        (i >> 13) - 16};
+        uint64_t lo, hi;
+        memcpy(&lo, &p[0], 8);
+        memcpy(&hi, &p[2], 8);
+        hashes[i] = hashmap_mix128(lo, hi, 0);
+    }
+    check_hashes("mix128", hashes, n);
+    for (int i = 0; i < n; i++) {
+        int32_t p[4] = {(i & 15) - 8, (i >> 4 & 15) - 8, (i >> 8 & 31) - 16,
+                        (i >> 13) - 16};
+        hashes[i] = hashmap_wyhash(p, sizeof(p), 0, 0);
+    }
+    check_hashes("wyhash (16 bytes)", hashes, n);
+
+    xfree(hashes);
+}
+
+// test_get_many looks up every other key of a map, along with keys that
+// aren't there, in batches of different sizes.
+static void test_get_many() {
+    bool fail = rand_alloc_fail;
+    rand_alloc_fail = false;
+    int n = 1000;
+    struct hashmap *map = hashmap_new_with_backend(test_backend, sizeof(int), 
+                                                   0, 0, 0, hash_int, 
+                                                   compare_ints_udata, NULL);
+    hashmap_incremental(map, test_incremental);
+    for (int i = 0; i < n; i += 2) {
+        assert(!hashmap_set(map, &i));
+    }
+    int keys[2000];
+    void *found[2000];
+    for (int i = 0; i < 2000; i++) {
+        keys[i] = i;
+    }
+    size_t lens[] = { 0, 1, 15, 16, 17, 2000 };
+    for (size_t j = 0; j < sizeof(lens)/sizeof(lens[0]); j++) {
+        size_t count = hashmap_get_many(map, keys, lens[j], found);
+        size_t expect = 0;
+        for (size_t i = 0; i < lens[j]; i++) {
+            bool there = keys[i] < n && keys[i] % 2 == 0;
+            assert(there ? *(int*)found[i] == keys[i] : !found[i]);
+            expect += there;
+        }
+        assert(count == expect);
+        assert(hashmap_get_many(map, keys, lens[j], NULL) == expect);
+    }
+    hashmap_free(map);
+    rand_alloc_fail = fail;
+}
+
+static void test_reserve() {
+    bool fail = rand_alloc_fail;
+    rand_alloc_fail = false;
+    int n = 1000;
+    struct hashmap *map = hashmap_new_with_backend(test_backend, sizeof(int), 
+                                                   0, 0, 0, hash_int, 
+                                                   compare_ints_udata, NULL);
+    hashmap_incremental(map, test_incremental);
+    for (int i = 0; i < 10; i++) {
+        assert(!hashmap_set(map, &i));
+    }
+    assert(hashmap_reserve(map, n));
+    size_t nbuckets = map->nbuckets;
+    assert(map->growat >= (size_t)n && !map->old_buckets);
+    for (int i = 0; i < n; i++) {
+        assert(i < 10 ? hashmap_set(map, &i) != NULL : !hashmap_set(map, &i));
+    }
+    assert(map->nbuckets == nbuckets && map->count == (size_t)n);
+    for (int i = 0; i < n; i++) {
+        assert(hashmap_delete(map, &i));
+    }
+    assert(map->nbuckets == nbuckets);
+    assert(hashmap_reserve(map, 1));
+    assert(map->nbuckets == nbuckets);
+    hashmap_free(map);
+    rand_alloc_fail = fail;
+}
+
 static void all() {
     int seed = getenv("SEED")?atoi(getenv("SEED")):time(NULL);
     int N = getenv("N")?atoi(getenv("N")):2000;
@@ -647,6 +1549,10 @@ static void all() {
     // test sip and murmur hashes
     assert(hashmap_sip("hello", 5, 1, 2) == 2957200328589801622);
     assert(hashmap_murmur("hello", 5, 1, 2) == 1682575153221130884);
+    assert(hashmap_wyhash("hello", 5, 1, 2) == 11994599316891476167u);
+    test_hash_quality();
+    test_get_many();
+    test_reserve();
 
     int *vals;
     while (!(vals = xmalloc(N * sizeof(int)))) {}
@@ -656,8 +1562,10 @@ static void all() {
 
     struct hashmap *map;
 
-    while (!(map = hashmap_new(sizeof(int), 0, seed, seed, 
-                               hash_int, compare_ints_udata, NULL))) {}
+    while (!(map = hashmap_new_with_backend(test_backend, sizeof(int), 0, 
+                                            seed, seed, hash_int, 
+                                            compare_ints_udata, NULL))) {}
+    hashmap_incremental(map, test_incremental);
     shuffle(vals, N, sizeof(int));
     for (int i = 0; i < N; i++) {
         // // printf("== %d ==\n", vals[i]);
@@ -766,7 +1674,7 @@ static void all() {
 
 #define bench(name, N, code) {{ \
     if (strlen(name) > 0) { \
-        printf("%-14s ", name); \
+        printf("%-16s ", name); \
     } \
     size_t tmem = total_mem; \
     size_t tallocs = total_allocs; \
@@ -797,6 +1705,30 @@ static void all() {
     printf("\n"); \
 }}
 
+static uint64_t now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec*1000000000+ts.tv_nsec;
+}
+
+// latency times each set on its own, because a resize shows up in the worst 
+// case long before it moves the average.
+static void latency(const char *name, struct hashmap *map, int *vals, int N) {
+    uint64_t total = 0, worst = 0;
+    int slow = 0;
+    for (int i = 0; i < N; i++) {
+        uint64_t begin = now_ns();
+        int *v = hashmap_set(map, &vals[i]);
+        uint64_t elapsed = now_ns()-begin;
+        assert(!v);
+        total += elapsed;
+        worst = elapsed > worst ? elapsed : worst;
+        slow += elapsed > 10000;
+    }
+    printf("%-16s %d ops, %.0f ns/op, worst %.3f ms, %d ops over 10 us\n",
+           name, N, (double)total/N, (double)worst/1e6, slow);
+}
+
 static void benchmarks() {
     int seed = getenv("SEED")?atoi(getenv("SEED")):time(NULL);
     int N = getenv("N")?atoi(getenv("N")):5000000;
@@ -826,6 +1758,14 @@ static void benchmarks() {
         assert(v && *v == vals[i]);
     })
     shuffle(vals, N, sizeof(int));
+    bench("get_many", N, {
+        if (i % HASHMAP_BATCH == 0) {
+            int n = N-i < HASHMAP_BATCH ? N-i : HASHMAP_BATCH;
+            size_t count = hashmap_get_many(map, &vals[i], n, NULL);
+            assert(count == n);
+        }
+    })
+    shuffle(vals, N, sizeof(int));
     bench("delete", N, {
         int *v = hashmap_delete(map, &vals[i]);
         assert(v && *v == vals[i]);
@@ -844,6 +1784,14 @@ static void benchmarks() {
         assert(v && *v == vals[i]);
     })
     shuffle(vals, N, sizeof(int));
+    bench("get_many (cap)", N, {
+        if (i % HASHMAP_BATCH == 0) {
+            int n = N-i < HASHMAP_BATCH ? N-i : HASHMAP_BATCH;
+            size_t count = hashmap_get_many(map, &vals[i], n, NULL);
+            assert(count == n);
+        }
+    })
+    shuffle(vals, N, sizeof(int));
     bench("delete (cap)" , N, {
         int *v = hashmap_delete(map, &vals[i]);
         assert(v && *v == vals[i]);
@@ -854,6 +1802,118 @@ static void benchmarks() {
     
     xfree(vals);
 
+    // the backends at high load factors: both filled to just under 3/4, 
+    // where the robinhood map grows, then swiss to just under 7/8.
+    struct {
+        const char *name;
+        enum hashmap_backend backend;
+        int load; // in eighths
+    } loads[] = {
+        { "rh 75%", HASHMAP_ROBINHOOD, 6 },
+        { "swiss 75%", HASHMAP_SWISS, 6 },
+        { "swiss 87%", HASHMAP_SWISS, 7 },
+    };
+    size_t nbuckets = 16;
+    while (nbuckets*2 <= (size_t)N) {
+        nbuckets *= 2;
+    }
+    while (!(vals = xmalloc(N * sizeof(int)))) {}
+    for (int i = 0; i < N; i++) {
+        vals[i] = i;
+    }
+    for (size_t j = 0; j < sizeof(loads)/sizeof(loads[0]); j++) {
+        int n = nbuckets*loads[j].load/8-1;
+        char name[32];
+        shuffle(vals, n, sizeof(int));
+        map = hashmap_new_with_backend(loads[j].backend, sizeof(int), nbuckets,
+                                       seed, seed, hash_int, 
+                                       compare_ints_udata, NULL);
+        snprintf(name, sizeof(name), "%s set", loads[j].name);
+        bench(name, n, {
+            int *v = hashmap_set(map, &vals[i]);
+            assert(!v);
+        })
+        assert(hashmap_count(map) == (size_t)n);
+        shuffle(vals, n, sizeof(int));
+        snprintf(name, sizeof(name), "%s get", loads[j].name);
+        bench(name, n, {
+            int *v = hashmap_get(map, &vals[i]);
+            assert(v && *v == vals[i]);
+        })
+        snprintf(name, sizeof(name), "%s miss", loads[j].name);
+        bench(name, n, {
+            int key = vals[i]+N;
+            int *v = hashmap_get(map, &key);
+            assert(!v);
+        })
+        snprintf(name, sizeof(name), "%s delete", loads[j].name);
+        bench(name, n, {
+            int *v = hashmap_delete(map, &vals[i]);
+            assert(v && *v == vals[i]);
+        })
+        hashmap_free(map);
+    }
+
+    // the worst case set, when growing all at once, growing incrementally and
+    // after reserving room for every item.
+    shuffle(vals, N, sizeof(int));
+    for (int j = 0; j < 3; j++) {
+        const char *names[] = { "grow latency", "incr latency", 
+                                "reserve latency" };
+        map = hashmap_new(sizeof(int), 0, seed, seed, hash_int, 
+                          compare_ints_udata, NULL);
+        hashmap_incremental(map, j == 1);
+        if (j == 2) {
+            assert(hashmap_reserve(map, N));
+        }
+        latency(names[j], map, vals, N);
+        assert(hashmap_count(map) == (size_t)N);
+        hashmap_free(map);
+    }
+    xfree(vals);
+
+    // hashes by key size, with fewer rounds for the larger keys.
+    char *buf = xmalloc(1024 + 256);
+    for (int i = 0; i < 1024 + 256; i++) {
+        buf[i] = rand();
+    }
+    uint64_t sink = 0;
+    size_t sizes[] = { 4, 8, 16, 32, 64, 256, 1024 };
+    for (size_t j = 0; j < sizeof(sizes)/sizeof(sizes[0]); j++) {
+        size_t size = sizes[j];
+        int M = size <= 16 ? N : (int)(N * 16 / size);
+        char name[32];
+        snprintf(name, sizeof(name), "sip %zu", size);
+        bench(name, M, {
+            sink += hashmap_sip(buf + (i & 255), size, seed, seed);
+            bytes += size;
+        })
+        snprintf(name, sizeof(name), "murmur %zu", size);
+        bench(name, M, {
+            sink += hashmap_murmur(buf + (i & 255), size, seed, seed);
+            bytes += size;
+        })
+        snprintf(name, sizeof(name), "wyhash %zu", size);
+        bench(name, M, {
+            sink += hashmap_wyhash(buf + (i & 255), size, seed, seed);
+            bytes += size;
+        })
+    }
+    bench("mix32", N, {
+        sink += hashmap_mix32(i, seed);
+        bytes += 4;
+    })
+    bench("mix64", N, {
+        sink += hashmap_mix64(i, seed);
+        bytes += 8;
+    })
+    bench("mix128", N, {
+        sink += hashmap_mix128(i, sink, seed);
+        bytes += 16;
+    })
+    printf("(checksum %llu)\n", (unsigned long long)sink);
+    xfree(buf);
+
     if (total_allocs != 0) {
         fprintf(stderr, "total_allocs: expected 0, got %lu\n", total_allocs);
         exit(1);
@@ -869,6 +1929,13 @@ int main() {
     } else {
         printf("Running hashmap.c tests...\n");
         all();
+        printf("Running hashmap.c tests (swiss)...\n");
+        test_backend = HASHMAP_SWISS;
+        all();
+        printf("Running hashmap.c tests (incremental)...\n");
+        test_backend = HASHMAP_ROBINHOOD;
+        test_incremental = true;
+        all();
         printf("PASSED\n");
     }
 }
@@ -12,6 +12,11 @@
 
 struct hashmap;
 
+enum hashmap_backend {
+    HASHMAP_ROBINHOOD, // buckets hold the item along with its hash
+    HASHMAP_SWISS,     // a separate array of hash bytes, probed with SIMD
+};
+
 struct hashmap *hashmap_new(size_t elsize, size_t cap, 
                             uint64_t seed0, uint64_t seed1,
                             uint64_t (*hash)(const void *item, 
@@ -30,11 +35,23 @@ struct hashmap *hashmap_new_with_allocator(
                             int (*compare)(const void *a, const void *b, 
                                            void *udata),
                             void *udata);
+struct hashmap *hashmap_new_with_backend(enum hashmap_backend backend,
+                            size_t elsize, size_t cap, 
+                            uint64_t seed0, uint64_t seed1,
+                            uint64_t (*hash)(const void *item, 
+                                             uint64_t seed0, uint64_t seed1),
+                            int (*compare)(const void *a, const void *b, 
+                                           void *udata),
+                            void *udata);
 void hashmap_free(struct hashmap *map);
 void hashmap_clear(struct hashmap *map, bool update_cap);
 size_t hashmap_count(struct hashmap *map);
 bool hashmap_oom(struct hashmap *map);
+bool hashmap_reserve(struct hashmap *map, size_t count);
+void hashmap_incremental(struct hashmap *map, bool incremental);
 void *hashmap_get(struct hashmap *map, void *item);
+size_t hashmap_get_many(struct hashmap *map, const void *keys, size_t n, 
+                        void **found);
 void *hashmap_set(struct hashmap *map, void *item);
 void *hashmap_delete(struct hashmap *map, void *item);
 void *hashmap_probe(struct hashmap *map, uint64_t position);
@@ -45,6 +62,34 @@ uint64_t hashmap_sip(const void *data, size_t len,
                      uint64_t seed0, uint64_t seed1);
 uint64_t hashmap_murmur(const void *data, size_t len, 
                         uint64_t seed0, uint64_t seed1);
+uint64_t hashmap_wyhash(const void *data, size_t len, 
+                        uint64_t seed0, uint64_t seed1);
+
+// Mixers for keys that are one, two or four 32-bit words. They're inline so 
+// that a hash function built on them can be inlined as well, and like 
+// hashmap_wyhash() they're meant for trusted inputs.
+
+// hashmap_mix64 is the splitmix64 finalizer.
+static inline uint64_t hashmap_mix64(uint64_t x, uint64_t seed) {
+    x ^= seed;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ull;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebull;
+    return x ^ (x >> 31);
+}
+
+// hashmap_mix32 needs a single multiplication, since the product of a 32-bit 
+// key already spreads it over the high half.
+static inline uint64_t hashmap_mix32(uint32_t x, uint64_t seed) {
+    uint64_t h = ((uint64_t)x ^ seed) * 0x9e3779b97f4a7c15ull;
+    return h ^ (h >> 32);
+}
+
+// hashmap_mix128 chains two rounds of hashmap_mix64, since mixing the halves
+// separately and combining them collides on small coordinates.
+static inline uint64_t hashmap_mix128(uint64_t lo, uint64_t hi, 
+                                      uint64_t seed) {
+    return hashmap_mix64(hi ^ hashmap_mix64(lo, seed), seed);
+}
 
 
 // DEPRECATED: use `hashmap_new_with_allocator`
@@ -0,0 +1,387 @@
+#ifndef HASHMAP_GEN_H
+#define HASHMAP_GEN_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+// How many lookups get_many hashes and prefetches before probing.
+#ifndef HASHMAP_GEN_BATCH
+#define HASHMAP_GEN_BATCH 16
+#endif
+
+#if defined(__GNUC__) || defined(__clang__)
+#define HASHMAP_GEN_PREFETCH(addr) __builtin_prefetch(addr)
+#else
+#define HASHMAP_GEN_PREFETCH(addr) ((void)(addr))
+#endif
+
+// Declares `struct name`, a Robin Hood hash map of `type` items, along with
+// its functions. It works like struct hashmap (the key is part of the item,
+// and set/delete return a copy of the replaced item, valid until the next
+// call), but the hash and equality functions are known at compile time:
+//     uint64_t hash_fn(const type *item);
+//     bool equal_fn(const type *a, const type *b);
+// so that they can be inlined into the lookups, instead of being called
+// through pointers. Declare it once per type, at file scope.
+#define HASHMAP_DEFINE(name, type, hash_fn, equal_fn)                          \
+    struct name##_bucket {                                                     \
+        type item;                                                             \
+        uint32_t hash;                                                         \
+        uint32_t dib; /* probe distance + 1, or 0 if empty */                  \
+    };                                                                         \
+                                                                               \
+    struct name {                                                              \
+        struct name##_bucket *buckets;                                         \
+        size_t nbuckets;                                                       \
+        size_t mask;                                                           \
+        size_t count;                                                          \
+        size_t cap;                                                            \
+        size_t growat;                                                         \
+        size_t shrinkat;                                                       \
+        type spare; /* the last replaced or deleted item */                    \
+    };                                                                         \
+                                                                               \
+    static inline void name##_resize(struct name *map, size_t nbuckets) {      \
+        struct name##_bucket *old = map->buckets;                              \
+        size_t old_nbuckets = map->nbuckets;                                   \
+                                                                               \
+        map->buckets = calloc(nbuckets, sizeof(*map->buckets));                \
+        map->nbuckets = nbuckets;                                              \
+        map->mask = nbuckets - 1;                                              \
+        map->growat = nbuckets * 3 / 4;                                        \
+        map->shrinkat = nbuckets / 10;                                         \
+                                                                               \
+        for(size_t i = 0; i < old_nbuckets; i++) {                             \
+            if(old[i].dib == 0) {                                              \
+                continue;                                                      \
+            }                                                                  \
+            struct name##_bucket entry = old[i];                               \
+            entry.dib = 1;                                                     \
+            for(size_t j = entry.hash & map->mask;; j = (j + 1) & map->mask) { \
+                struct name##_bucket *bucket = &map->buckets[j];               \
+                if(bucket->dib == 0) {                                         \
+                    *bucket = entry;                                           \
+                    break;                                                     \
+                }                                                              \
+                if(bucket->dib < entry.dib) {                                  \
+                    struct name##_bucket tmp = *bucket;                        \
+                    *bucket = entry;                                           \
+                    entry = tmp;                                               \
+                }                                                              \
+                entry.dib++;                                                   \
+            }                                                                  \
+        }                                                                      \
+        free(old);                                                             \
+    }                                                                          \
+                                                                               \
+    static inline struct name *name##_new(size_t cap) {                        \
+        size_t nbuckets = 16;                                                  \
+        while(nbuckets < cap) {                                                \
+            nbuckets *= 2;                                                     \
+        }                                                                      \
+                                                                               \
+        struct name *map = malloc(sizeof(*map));                               \
+        map->buckets = NULL;                                                   \
+        map->nbuckets = 0;                                                     \
+        map->count = 0;                                                        \
+        map->cap = nbuckets;                                                   \
+        name##_resize(map, nbuckets);                                          \
+        return map;                                                            \
+    }                                                                          \
+                                                                               \
+    static inline void name##_free(struct name *map) {                         \
+        free(map->buckets);                                                    \
+        free(map);                                                             \
+    }                                                                          \
+                                                                               \
+    static inline size_t name##_count(const struct name *map) {                \
+        return map->count;                                                     \
+    }                                                                          \
+                                                                               \
+    static inline void name##_clear(struct name *map) {                        \
+        memset(map->buckets, 0, map->nbuckets * sizeof(*map->buckets));        \
+        map->count = 0;                                                        \
+    }                                                                          \
+                                                                               \
+    static inline type *name##_get_hashed(struct name *map, const type *item,  \
+                                          uint32_t hash) {                     \
+        uint32_t dib = 1;                                                      \
+        for(size_t i = hash & map->mask;; i = (i + 1) & map->mask, dib++) {    \
+            struct name##_bucket *bucket = &map->buckets[i];                   \
+            /* the item would have taken the place of any item that's closer   \
+               to its own bucket. */                                           \
+            if(bucket->dib < dib) {                                            \
+                return NULL;                                                   \
+            }                                                                  \
+            if(bucket->hash == hash && equal_fn(&bucket->item, item)) {        \
+                return &bucket->item;                                          \
+            }                                                                  \
+        }                                                                      \
+    }                                                                          \
+                                                                               \
+    static inline type *name##_get(struct name *map, const type *item) {       \
+        return name##_get_hashed(map, item, (uint32_t)hash_fn(item));          \
+    }                                                                          \
+                                                                               \
+    /* looks up `n` items, hashing and prefetching a batch of them before      \
+       probing for any, so that their cache misses overlap. `found` gets the   \
+       items (or NULL), unless it's NULL. returns how many were found. */      \
+    static inline size_t name##_get_many(struct name *map, const type *items,  \
+                                         size_t n, type **found) {             \
+        size_t count = 0;                                                      \
+        uint32_t hashes[HASHMAP_GEN_BATCH];                                    \
+        for(size_t start = 0; start < n; start += HASHMAP_GEN_BATCH) {         \
+            const type *batch = &items[start];                                 \
+            size_t len = n - start;                                            \
+            len = len < HASHMAP_GEN_BATCH ? len : HASHMAP_GEN_BATCH;           \
+            for(size_t i = 0; i < len; i++) {                                  \
+                hashes[i] = (uint32_t)hash_fn(&batch[i]);                      \
+                HASHMAP_GEN_PREFETCH(&map->buckets[hashes[i] & map->mask]);    \
+            }                                                                  \
+            for(size_t i = 0; i < len; i++) {                                  \
+                type *item = name##_get_hashed(map, &batch[i], hashes[i]);     \
+                count += item != NULL;                                         \
+                if(NULL != found) {                                            \
+                    found[start + i] = item;                                   \
+                }                                                              \
+            }                                                                  \
+        }                                                                      \
+        return count;                                                          \
+    }                                                                          \
+                                                                               \
+    static inline type *name##_set(struct name *map, const type *item) {       \
+        if(map->count == map->growat) {                                        \
+            name##_resize(map, map->nbuckets * 2);                             \
+        }                                                                      \
+                                                                               \
+        struct name##_bucket entry;                                            \
+        entry.item = *item;                                                    \
+        entry.hash = (uint32_t)hash_fn(item);                                  \
+        entry.dib = 1;                                                         \
+        for(size_t i = entry.hash & map->mask;; i = (i + 1) & map->mask) {     \
+            struct name##_bucket *bucket = &map->buckets[i];                   \
+            if(bucket->dib == 0) {                                             \
+                *bucket = entry;                                               \
+                map->count++;                                                  \
+                return NULL;                                                   \
+            }                                                                  \
+            if(bucket->hash == entry.hash &&                                   \
+               equal_fn(&bucket->item, &entry.item)) {                         \
+                map->spare = bucket->item;                                     \
+                bucket->item = entry.item;                                     \
+                return &map->spare;                                            \
+            }                                                                  \
+            if(bucket->dib < entry.dib) {                                      \
+                struct name##_bucket tmp = *bucket;                            \
+                *bucket = entry;                                               \
+                entry = tmp;                                                   \
+            }                                                                  \
+            entry.dib++;                                                       \
+        }                                                                      \
+    }                                                                          \
+                                                                               \
+    static inline type *name##_delete(struct name *map, const type *item) {    \
+        uint32_t hash = (uint32_t)hash_fn(item);                               \
+        uint32_t dib = 1;                                                      \
+        size_t i = hash & map->mask;                                           \
+        for(;; i = (i + 1) & map->mask, dib++) {                               \
+            struct name##_bucket *bucket = &map->buckets[i];                   \
+            if(bucket->dib < dib) {                                            \
+                return NULL;                                                   \
+            }                                                                  \
+            if(bucket->hash == hash && equal_fn(&bucket->item, item)) {        \
+                break;                                                         \
+            }                                                                  \
+        }                                                                      \
+                                                                               \
+        map->spare = map->buckets[i].item;                                     \
+        /* shifts the next items back, up to one that is in its bucket. */     \
+        for(;;) {                                                              \
+            struct name##_bucket *prev = &map->buckets[i];                     \
+            i = (i + 1) & map->mask;                                           \
+            struct name##_bucket *bucket = &map->buckets[i];                   \
+            if(bucket->dib <= 1) {                                             \
+                prev->dib = 0;                                                 \
+                break;                                                         \
+            }                                                                  \
+            *prev = *bucket;                                                   \
+            prev->dib--;                                                       \
+        }                                                                      \
+        map->count--;                                                          \
+                                                                               \
+        if(map->nbuckets > map->cap && map->count <= map->shrinkat) {          \
+            name##_resize(map, map->nbuckets / 2);                             \
+        }                                                                      \
+        return &map->spare;                                                    \
+    }                                                                          \
+                                                                               \
+    static inline bool name##_scan(                                            \
+        struct name *map, bool (*iter)(const type *item, void *udata),         \
+        void *udata) {                                                         \
+        for(size_t i = 0; i < map->nbuckets; i++) {                            \
+            if(map->buckets[i].dib != 0 &&                                     \
+               !iter(&map->buckets[i].item, udata)) {                          \
+                return false;                                                  \
+            }                                                                  \
+        }                                                                      \
+        return true;                                                           \
+    }
+
+//==============================================================================
+// TESTS
+// $ cc -DHASHMAP_GEN_TEST -x c hashmap_gen.h && ./a.out  # run tests
+//==============================================================================
+#ifdef HASHMAP_GEN_TEST
+
+#include <assert.h>
+#include <stdio.h>
+
+#include "hashmap.h"
+
+struct kv {
+    uint64_t key;
+    uint64_t value;
+};
+
+static uint64_t kv_hash(const struct kv *item) {
+    return hashmap_mix64(item->key, 0);
+}
+
+// puts every key into one of a few buckets, so that the probes are long and
+// every delete has items to shift back.
+static uint64_t kv_hash_clumped(const struct kv *item) {
+    return item->key % 5;
+}
+
+static bool kv_equal(const struct kv *a, const struct kv *b) {
+    return a->key == b->key;
+}
+
+HASHMAP_DEFINE(kvmap, struct kv, kv_hash, kv_equal)
+HASHMAP_DEFINE(clumpmap, struct kv, kv_hash_clumped, kv_equal)
+
+// checks that every item is as far from its bucket as its dib says, and that
+// the map counts as many items as it holds.
+#define check_buckets(name, map, hash_fn)                                      \
+    {                                                                          \
+        size_t count = 0;                                                      \
+        for(size_t i = 0; i < (map)->nbuckets; i++) {                          \
+            struct name##_bucket *bucket = &(map)->buckets[i];                 \
+            if(bucket->dib == 0) {                                             \
+                continue;                                                      \
+            }                                                                  \
+            count++;                                                           \
+            assert(bucket->hash == (uint32_t)hash_fn(&bucket->item));          \
+            assert(((i - bucket->hash) & (map)->mask) == bucket->dib - 1);     \
+        }                                                                      \
+        assert(count == (map)->count);                                         \
+    }
+
+static void test_set_get(int n) {
+    struct kvmap *map = kvmap_new(0);
+    for(int i = 0; i < n; i++) {
+        struct kv item = {i, i};
+        assert(NULL == kvmap_set(map, &item));
+        assert(kvmap_count(map) == (size_t)i + 1);
+    }
+    check_buckets(kvmap, map, kv_hash);
+    for(int i = 0; i < n; i++) {
+        struct kv *item = kvmap_get(map, &(struct kv){i, 0});
+        assert(NULL != item && item->value == (uint64_t)i);
+    }
+    assert(NULL == kvmap_get(map, &(struct kv){n, 0}));
+
+    // an overwrite returns the item it replaced, and doesn't count.
+    for(int i = 0; i < n; i++) {
+        struct kv item = {i, i * 2};
+        struct kv *old = kvmap_set(map, &item);
+        assert(NULL != old && old->key == (uint64_t)i &&
+               old->value == (uint64_t)i);
+    }
+    assert(kvmap_count(map) == (size_t)n);
+    for(int i = 0; i < n; i++) {
+        assert(kvmap_get(map, &(struct kv){i, 0})->value == (uint64_t)i * 2);
+    }
+
+    kvmap_clear(map);
+    assert(kvmap_count(map) == 0 && NULL == kvmap_get(map, &(struct kv){0}));
+    kvmap_free(map);
+}
+
+static void test_delete(int n) {
+    struct clumpmap *map = clumpmap_new(n * 2);
+    for(int i = 0; i < n; i++) {
+        assert(NULL == clumpmap_set(map, &(struct kv){i, i}));
+    }
+    check_buckets(clumpmap, map, kv_hash_clumped);
+
+    // deleting every other key shifts the ones after it back, which have to
+    // stay reachable.
+    for(int i = 0; i < n; i += 2) {
+        struct kv *old = clumpmap_delete(map, &(struct kv){i, 0});
+        assert(NULL != old && old->key == (uint64_t)i &&
+               old->value == (uint64_t)i);
+        assert(NULL == clumpmap_delete(map, &(struct kv){i, 0}));
+        check_buckets(clumpmap, map, kv_hash_clumped);
+    }
+    assert(clumpmap_count(map) == (size_t)n / 2);
+    for(int i = 0; i < n; i++) {
+        struct kv *item = clumpmap_get(map, &(struct kv){i, 0});
+        assert((i % 2 == 0) == (NULL == item));
+        assert(NULL == item || item->value == (uint64_t)i);
+    }
+    clumpmap_free(map);
+
+    // the map shrinks back to its capacity as it empties.
+    struct kvmap *big = kvmap_new(0);
+    for(int i = 0; i < n * 10; i++) {
+        kvmap_set(big, &(struct kv){i, i});
+    }
+    for(int i = 0; i < n * 10; i++) {
+        assert(NULL != kvmap_delete(big, &(struct kv){i, 0}));
+    }
+    check_buckets(kvmap, big, kv_hash);
+    assert(kvmap_count(big) == 0 && big->nbuckets == big->cap);
+    kvmap_free(big);
+}
+
+static void test_get_many(int n) {
+    struct kvmap *map = kvmap_new(0);
+    for(int i = 0; i < n; i += 3) {
+        kvmap_set(map, &(struct kv){i, i + 1});
+    }
+    // not a multiple of the batch size, so that the last batch is partial.
+    int len = n + HASHMAP_GEN_BATCH / 2;
+    struct kv *keys = malloc(sizeof(*keys) * len);
+    struct kv **found = malloc(sizeof(*found) * len);
+    size_t want = 0;
+    for(int i = 0; i < len; i++) {
+        keys[i] = (struct kv){i, 0};
+        want += i < n && i % 3 == 0;
+    }
+    assert(kvmap_get_many(map, keys, len, found) == want);
+    for(int i = 0; i < len; i++) {
+        assert(found[i] == kvmap_get(map, &keys[i]));
+        assert(NULL == found[i] || found[i]->value == (uint64_t)i + 1);
+    }
+    assert(kvmap_get_many(map, keys, len, NULL) == want);
+    assert(kvmap_get_many(map, keys, 0, found) == 0);
+    free(keys);
+    free(found);
+    kvmap_free(map);
+}
+
+int main(void) {
+    printf("Running hashmap_gen.h tests...\n");
+    test_set_get(5000);
+    test_delete(1000);
+    test_get_many(1000);
+    printf("PASSED\n");
+}
+
+#endif
+
+#endif // HASHMAP_GEN_H
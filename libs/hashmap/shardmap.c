@@ -0,0 +1,361 @@
+#include "shardmap.h"
+#include "hashmap.h"
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define SHARDMAP_DEFAULT_SHARDS 64
+// shards are padded to this size, so that two threads that lock neighboring
+// shards don't keep taking the same cache line from each other.
+#define SHARDMAP_CACHE_LINE 64
+
+struct shard {
+    pthread_mutex_t lock;
+    struct hashmap *map;
+    char padding[SHARDMAP_CACHE_LINE -
+                 (sizeof(pthread_mutex_t) + sizeof(struct hashmap *)) %
+                     SHARDMAP_CACHE_LINE];
+};
+
+struct shardmap {
+    struct shard *shards;
+    size_t nshards;
+    int shift; // the shard is the top bits of the hash
+    size_t elsize;
+    uint64_t seed0, seed1;
+    uint64_t (*hash)(const void *item, uint64_t seed0, uint64_t seed1);
+    // updated under the lock of the shard that changed, at the same moment
+    // as the shard itself, so a count is always one the map really had.
+    atomic_size_t count;
+};
+
+static struct shard *shard_of(struct shardmap *map, const void *key);
+
+struct shardmap *shardmap_new(size_t nshards, size_t elsize, size_t cap,
+                              uint64_t seed0, uint64_t seed1,
+                              uint64_t (*hash)(const void *item, uint64_t seed0,
+                                               uint64_t seed1),
+                              int (*compare)(const void *a, const void *b,
+                                             void *udata),
+                              void *udata) {
+    if(nshards == 0) {
+        nshards = SHARDMAP_DEFAULT_SHARDS;
+    }
+    size_t rounded = 1;
+    int shift = 64;
+    while(rounded < nshards) {
+        rounded *= 2;
+        shift--;
+    }
+
+    struct shardmap *map = malloc(sizeof(*map));
+    if(NULL == map) {
+        return NULL;
+    }
+    map->shards =
+        aligned_alloc(SHARDMAP_CACHE_LINE, rounded * sizeof(*map->shards));
+    if(NULL == map->shards) {
+        free(map);
+        return NULL;
+    }
+    memset(map->shards, 0, rounded * sizeof(*map->shards));
+    map->nshards = rounded;
+    map->shift = shift;
+    map->elsize = elsize;
+    map->seed0 = seed0;
+    map->seed1 = seed1;
+    map->hash = hash;
+    atomic_init(&map->count, 0);
+
+    for(size_t i = 0; i < rounded; i++) {
+        struct shard *shard = &map->shards[i];
+        shard->map = hashmap_new(elsize, cap / rounded, seed0, seed1, hash,
+                                 compare, udata);
+        if(NULL == shard->map) {
+            map->nshards = i;
+            shardmap_free(map);
+            return NULL;
+        }
+        pthread_mutex_init(&shard->lock, NULL);
+    }
+
+    return map;
+}
+
+void shardmap_free(struct shardmap *map) {
+    for(size_t i = 0; i < map->nshards; i++) {
+        pthread_mutex_destroy(&map->shards[i].lock);
+        hashmap_free(map->shards[i].map);
+    }
+    free(map->shards);
+    free(map);
+}
+
+size_t shardmap_count(struct shardmap *map) {
+    return atomic_load(&map->count);
+}
+
+// copies the item with the same key to `out`, if there's one.
+bool shardmap_get(struct shardmap *map, const void *key, void *out) {
+    struct shard *shard = shard_of(map, key);
+    pthread_mutex_lock(&shard->lock);
+    void *found = hashmap_get(shard->map, (void *)key);
+    if(NULL != found && NULL != out) {
+        memcpy(out, found, map->elsize);
+    }
+    pthread_mutex_unlock(&shard->lock);
+    return NULL != found;
+}
+
+// copies the item that was replaced, if any, to `replaced` (which may be
+// NULL).
+enum shardmap_result shardmap_set(struct shardmap *map, const void *item,
+                                  void *replaced) {
+    struct shard *shard = shard_of(map, item);
+    enum shardmap_result result;
+    pthread_mutex_lock(&shard->lock);
+    void *old = hashmap_set(shard->map, (void *)item);
+    if(NULL != old) {
+        if(NULL != replaced) {
+            memcpy(replaced, old, map->elsize);
+        }
+        result = SHARDMAP_REPLACED;
+    } else if(hashmap_oom(shard->map)) {
+        result = SHARDMAP_OOM;
+    } else {
+        atomic_fetch_add(&map->count, 1);
+        result = SHARDMAP_INSERTED;
+    }
+    pthread_mutex_unlock(&shard->lock);
+    return result;
+}
+
+// copies the deleted item, if there was one, to `deleted` (which may be
+// NULL).
+bool shardmap_delete(struct shardmap *map, const void *key, void *deleted) {
+    struct shard *shard = shard_of(map, key);
+    pthread_mutex_lock(&shard->lock);
+    void *old = hashmap_delete(shard->map, (void *)key);
+    if(NULL != old) {
+        if(NULL != deleted) {
+            memcpy(deleted, old, map->elsize);
+        }
+        atomic_fetch_sub(&map->count, 1);
+    }
+    pthread_mutex_unlock(&shard->lock);
+    return NULL != old;
+}
+
+// visits the shards one at a time, holding each one's lock while its items
+// are visited. `iter` must not use the map.
+bool shardmap_scan(struct shardmap *map,
+                   bool (*iter)(const void *item, void *udata), void *udata) {
+    for(size_t i = 0; i < map->nshards; i++) {
+        struct shard *shard = &map->shards[i];
+        pthread_mutex_lock(&shard->lock);
+        bool more = hashmap_scan(shard->map, iter, udata);
+        pthread_mutex_unlock(&shard->lock);
+        if(!more) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// the shards use the top bits of the hash, since the hashmaps inside them
+// pick their buckets with the low bits.
+static struct shard *shard_of(struct shardmap *map, const void *key) {
+    if(map->nshards == 1) {
+        return &map->shards[0];
+    }
+    uint64_t hash = map->hash(key, map->seed0, map->seed1);
+    return &map->shards[hash >> map->shift];
+}
+
+//==============================================================================
+// TESTS AND BENCHMARKS
+// $ cc -DSHARDMAP_TEST -pthread shardmap.c hashmap.c && ./a.out
+// $ cc -DSHARDMAP_TEST -pthread -O3 shardmap.c hashmap.c && BENCH=1 ./a.out
+// (THREADS sets the most threads to run, instead of one per core.)
+//==============================================================================
+#ifdef SHARDMAP_TEST
+
+#include <assert.h>
+#include <stdio.h>
+#include <time.h>
+#include <unistd.h>
+
+#define MAX_THREADS 64
+
+struct kv {
+    uint64_t key;
+    uint64_t value;
+};
+
+struct worker {
+    struct shardmap *map;
+    int id;
+    int nthreads;
+    int n;
+    size_t ops;
+};
+
+static uint64_t kv_hash(const void *item, uint64_t seed0, uint64_t seed1) {
+    return hashmap_mix64(((const struct kv *)item)->key, seed0 ^ seed1);
+}
+
+static int kv_compare(const void *a, const void *b, void *udata) {
+    uint64_t x = ((const struct kv *)a)->key, y = ((const struct kv *)b)->key;
+    return (x > y) - (x < y);
+}
+
+// every thread inserts its own keys, then replaces them, then deletes every
+// other one. all of them look at each other's keys all the while.
+static void *test_worker(void *arg) {
+    struct worker *worker = arg;
+    for(int i = worker->id; i < worker->n; i += worker->nthreads) {
+        struct kv item = {i, i};
+        assert(shardmap_set(worker->map, &item, NULL) == SHARDMAP_INSERTED);
+        struct kv other = {(i + 1) % worker->n, 0};
+        shardmap_get(worker->map, &other, &other);
+        assert(other.value == 0 || other.value == other.key ||
+               other.value == other.key * 2);
+    }
+    for(int i = worker->id; i < worker->n; i += worker->nthreads) {
+        struct kv item = {i, i * 2}, old;
+        assert(shardmap_set(worker->map, &item, &old) == SHARDMAP_REPLACED);
+        assert(old.key == (uint64_t)i && old.value == (uint64_t)i);
+    }
+    for(int i = worker->id; i < worker->n; i += 2 * worker->nthreads) {
+        struct kv item = {i, 0};
+        assert(shardmap_delete(worker->map, &item, &item));
+        assert(item.value == (uint64_t)i * 2);
+        assert(!shardmap_delete(worker->map, &item, NULL));
+    }
+    return NULL;
+}
+
+static bool count_iter(const void *item, void *udata) {
+    (*(size_t *)udata)++;
+    return true;
+}
+
+static void run_workers(struct worker *workers, int nthreads,
+                        void *(*run)(void *)) {
+    pthread_t threads[MAX_THREADS];
+    for(int t = 0; t < nthreads; t++) {
+        pthread_create(&threads[t], NULL, run, &workers[t]);
+    }
+    for(int t = 0; t < nthreads; t++) {
+        pthread_join(threads[t], NULL);
+    }
+}
+
+static void test_threads(int nthreads, size_t nshards) {
+    int n = 20000;
+    struct shardmap *map = shardmap_new(nshards, sizeof(struct kv), 0, 0, 0,
+                                        kv_hash, kv_compare, NULL);
+    struct worker workers[MAX_THREADS];
+    for(int t = 0; t < nthreads; t++) {
+        workers[t] = (struct worker){map, t, nthreads, n, 0};
+    }
+    run_workers(workers, nthreads, test_worker);
+
+    size_t remaining = 0;
+    for(int t = 0; t < nthreads; t++) {
+        for(int i = t; i < n; i += nthreads) {
+            remaining += (i - t) % (2 * nthreads) != 0;
+        }
+    }
+    assert(shardmap_count(map) == remaining);
+    size_t scanned = 0;
+    shardmap_scan(map, count_iter, &scanned);
+    assert(scanned == remaining);
+    for(int i = 0; i < n; i++) {
+        struct kv item = {i, 0};
+        int t = i % nthreads;
+        bool kept = (i - t) % (2 * nthreads) != 0;
+        assert(shardmap_get(map, &item, &item) == kept);
+        assert(!kept || item.value == (uint64_t)i * 2);
+    }
+    shardmap_free(map);
+}
+
+// a mix of 80% lookups, 10% inserts and 10% deletes over a fixed range of
+// keys, about half of which are in the map at any time.
+static void *bench_worker(void *arg) {
+    struct worker *worker = arg;
+    uint64_t state = worker->id * 0x9e3779b97f4a7c15ull + 1;
+    for(size_t i = 0; i < worker->ops; i++) {
+        state ^= state << 13;
+        state ^= state >> 7;
+        state ^= state << 17;
+        struct kv item = {(state >> 8) % worker->n, i};
+        int op = state % 10;
+        if(op == 0) {
+            shardmap_set(worker->map, &item, NULL);
+        } else if(op == 1) {
+            shardmap_delete(worker->map, &item, NULL);
+        } else {
+            shardmap_get(worker->map, &item, &item);
+        }
+    }
+    return NULL;
+}
+
+static double wall_time(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+static void benchmarks(void) {
+    int ncores = getenv("THREADS") ? atoi(getenv("THREADS"))
+                                   : sysconf(_SC_NPROCESSORS_ONLN);
+    ncores = ncores < 1 ? 1 : ncores > MAX_THREADS ? MAX_THREADS : ncores;
+    size_t N = getenv("N") ? atoi(getenv("N")) : 4000000;
+    int keys = 1 << 20;
+    printf("ops=%zu, keys=%d, max threads=%d\n", N, keys, ncores);
+
+    // powers of two, then all the cores.
+    for(int nthreads = 1; nthreads <= ncores;
+        nthreads = nthreads < ncores && nthreads * 2 > ncores ? ncores
+                                                              : nthreads * 2) {
+        struct shardmap *map = shardmap_new(0, sizeof(struct kv), keys, 0, 0,
+                                            kv_hash, kv_compare, NULL);
+        for(int i = 0; i < keys; i += 2) {
+            struct kv item = {i, i};
+            shardmap_set(map, &item, NULL);
+        }
+
+        struct worker workers[MAX_THREADS];
+        for(int t = 0; t < nthreads; t++) {
+            workers[t] = (struct worker){map, t, nthreads, keys, N / nthreads};
+        }
+        double begin = wall_time();
+        run_workers(workers, nthreads, bench_worker);
+        double elapsed = wall_time() - begin;
+        printf("%2d threads: %zu ops in %.3f secs, %.0f ns/op, %.2f Mop/sec\n",
+               nthreads, N, elapsed, elapsed / N * 1e9, N / elapsed / 1e6);
+        shardmap_free(map);
+    }
+}
+
+int main(void) {
+    if(getenv("BENCH")) {
+        printf("Running shardmap.c benchmarks...\n");
+        benchmarks();
+    } else {
+        printf("Running shardmap.c tests...\n");
+        int counts[] = {1, 2, 3, 8};
+        for(size_t i = 0; i < sizeof(counts) / sizeof(counts[0]); i++) {
+            test_threads(counts[i], 0);
+            test_threads(counts[i], 1);
+        }
+        printf("PASSED\n");
+    }
+}
+
+#endif
@@ -0,0 +1,40 @@
+#ifndef SHARDMAP_H
+#define SHARDMAP_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// A hashmap that can be used from several threads at once. The items are
+// spread over shards by their hash, and each shard is a struct hashmap with
+// its own lock, so threads only wait on each other when they use the same
+// shard. Since another thread may change an item at any time, items are
+// copied in and out instead of being returned by pointer.
+struct shardmap;
+
+enum shardmap_result {
+    SHARDMAP_INSERTED,
+    SHARDMAP_REPLACED,
+    SHARDMAP_OOM,
+};
+
+// `nshards` is rounded up to a power of two; 0 picks a default. The other
+// params are the same as hashmap_new's. The hash is also used to pick the
+// shard, so it's called twice for every operation.
+struct shardmap *shardmap_new(size_t nshards, size_t elsize, size_t cap,
+                              uint64_t seed0, uint64_t seed1,
+                              uint64_t (*hash)(const void *item, uint64_t seed0,
+                                               uint64_t seed1),
+                              int (*compare)(const void *a, const void *b,
+                                             void *udata),
+                              void *udata);
+void shardmap_free(struct shardmap *map);
+size_t shardmap_count(struct shardmap *map);
+bool shardmap_get(struct shardmap *map, const void *key, void *out);
+enum shardmap_result shardmap_set(struct shardmap *map, const void *item,
+                                  void *replaced);
+bool shardmap_delete(struct shardmap *map, const void *key, void *deleted);
+bool shardmap_scan(struct shardmap *map,
+                   bool (*iter)(const void *item, void *udata), void *udata);
+
+#endif // SHARDMAP_H
@@ -1,12 +1,16 @@
 #include "vector.h"
+#include <stdbool.h>
 #include <stdlib.h>
 #include <string.h>
 
-#define VECTOR_DEFAULT_CAPACITY 4
-
 typedef struct vector vector_t;
 
 static void vector_make_room(vector_t *vec);
+static uint64_t uvector_hash(const struct uvector *uvec, const void *item);
+static bool uvector_equal(const struct uvector *uvec, const void *a,
+                          const void *b);
+static void uvector_build_index(struct uvector *uvec, size_t slots);
+static void uvector_index_item(struct uvector *uvec, size_t item);
 
 vector_t *vector_init(size_t item_size) {
     vector_t *vector = malloc(sizeof(*vector));
@@ -71,3 +75,289 @@ static void vector_make_room(vector_t *vec) {
         vec->items = realloc(vec->items, vec->capacity * vec->item_size);
     }
 }
+
+struct uvector *uvector_init(size_t item_size,
+                             uint64_t (*hash)(const void *item, uint64_t seed0,
+                                              uint64_t seed1),
+                             int (*compare)(const void *a, const void *b,
+                                            void *udata)) {
+    struct uvector *uvec = malloc(sizeof(*uvec));
+    uvec->vec.items = NULL;
+    uvec->vec.capacity = 0;
+    uvec->vec.length = 0;
+    uvec->vec.item_size = item_size;
+    uvec->index = NULL;
+    uvec->index_slots = 0;
+    uvec->hash = hash;
+    uvec->compare = compare;
+
+    return uvec;
+}
+
+void *uvector_push_unique(struct uvector *uvec, const void *item) {
+    void *found = uvector_find(uvec, item);
+    if(NULL != found) {
+        return found;
+    }
+
+    void *pushed = vector_push(&uvec->vec, item);
+    if(NULL != uvec->index) {
+        // the index is kept at most half full.
+        if(2 * uvec->vec.length > uvec->index_slots) {
+            uvector_build_index(uvec, 2 * uvec->index_slots);
+        } else {
+            uvector_index_item(uvec, uvec->vec.length - 1);
+        }
+    } else if(uvec->vec.length > UVECTOR_INDEX_THRESHOLD) {
+        size_t slots = 4;
+        while(slots < 2 * uvec->vec.length) {
+            slots *= 2;
+        }
+        uvector_build_index(uvec, slots);
+    }
+
+    return pushed;
+}
+
+void *uvector_find(const struct uvector *uvec, const void *item) {
+    const size_t item_size = uvec->vec.item_size;
+    if(NULL == uvec->index) {
+        char *current_item = uvec->vec.items;
+        for(size_t i = 0; i < uvec->vec.length; i++) {
+            if(uvector_equal(uvec, current_item, item)) {
+                return current_item;
+            }
+
+            current_item += item_size;
+        }
+
+        return NULL;
+    }
+
+    size_t mask = uvec->index_slots - 1;
+    for(size_t slot = uvector_hash(uvec, item) & mask;
+        0 != uvec->index[slot]; slot = (slot + 1) & mask) {
+        char *current_item =
+            uvec->vec.items + (uvec->index[slot] - 1) * item_size;
+        if(uvector_equal(uvec, current_item, item)) {
+            return current_item;
+        }
+    }
+
+    return NULL;
+}
+
+void uvector_free(struct uvector *uvec) {
+    free(uvec->vec.items);
+    free(uvec->index);
+    free(uvec);
+}
+
+// FNV-1a over the item's bytes, when there's no hash callback.
+static uint64_t uvector_hash(const struct uvector *uvec, const void *item) {
+    if(NULL != uvec->hash) {
+        return uvec->hash(item, 0, 0);
+    }
+
+    const unsigned char *bytes = item;
+    uint64_t hash = 0xcbf29ce484222325ull;
+    for(size_t i = 0; i < uvec->vec.item_size; i++) {
+        hash = (hash ^ bytes[i]) * 0x100000001b3ull;
+    }
+    return hash;
+}
+
+static bool uvector_equal(const struct uvector *uvec, const void *a,
+                          const void *b) {
+    if(NULL != uvec->compare) {
+        return 0 == uvec->compare(a, b, NULL);
+    }
+    return 0 == memcmp(a, b, uvec->vec.item_size);
+}
+
+static void uvector_build_index(struct uvector *uvec, size_t slots) {
+    free(uvec->index);
+    uvec->index = calloc(slots, sizeof(*uvec->index));
+    uvec->index_slots = slots;
+    for(size_t i = 0; i < uvec->vec.length; i++) {
+        uvector_index_item(uvec, i);
+    }
+}
+
+static void uvector_index_item(struct uvector *uvec, size_t item) {
+    size_t mask = uvec->index_slots - 1;
+    size_t slot =
+        uvector_hash(uvec, uvec->vec.items + item * uvec->vec.item_size) &
+        mask;
+    while(0 != uvec->index[slot]) {
+        slot = (slot + 1) & mask;
+    }
+    uvec->index[slot] = item + 1;
+}
+
+//==============================================================================
+// TESTS AND BENCHMARKS
+// $ cc -DVECTOR_TEST vector.c && ./a.out              # run tests
+// $ cc -DVECTOR_TEST -O3 vector.c && BENCH=1 ./a.out  # run benchmarks
+//==============================================================================
+#ifdef VECTOR_TEST
+
+#include <assert.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+
+struct pair {
+    uint64_t a, b;
+};
+
+VECTOR_DEFINE(intvec, int)
+VECTOR_DEFINE(ptrvec, void *)
+VECTOR_DEFINE(pairvec, struct pair)
+SMALLVEC_DEFINE(intsmallvec, int, 4)
+SMALLVEC_DEFINE(pairsmallvec, struct pair, 1)
+
+static void test_typed(void) {
+    struct intvec vec = {0};
+    for(int i = 0; i < 1000; i++) {
+        assert(*intvec_push(&vec, i) == i);
+    }
+    assert(vec.length == 1000 && vec.capacity >= 1000);
+
+    intvec_erase(&vec, 10, 990);
+    assert(vec.length == 10);
+    intvec_insert(&vec, 0, -1);
+    intvec_insert(&vec, vec.length, 10);
+    for(size_t i = 0; i < vec.length; i++) {
+        assert(vec.items[i] == (int)i - 1);
+    }
+
+    int more[] = {11, 12, 13};
+    intvec_append(&vec, more, 3);
+    assert(intvec_pop(&vec) == 13 && vec.length == 14);
+
+    intvec_free(&vec);
+    intvec_reserve(&vec, 7);
+    assert(vec.capacity == 7 && vec.length == 0);
+    intvec_free(&vec);
+}
+
+static void test_unique(void) {
+    struct uvector *uvec = uvector_init(sizeof(int), NULL, NULL);
+    for(int round = 0; round < 3; round++) {
+        for(int i = 0; i < 1000; i++) {
+            assert(*(int *)uvector_push_unique(uvec, &i) == i);
+        }
+    }
+    assert(uvec->vec.length == 1000);
+    for(int i = 0; i < 1000; i++) {
+        assert(((int *)uvec->vec.items)[i] == i);
+    }
+    int missing = -1;
+    assert(NULL == uvector_find(uvec, &missing));
+    uvector_free(uvec);
+}
+
+static void test_small(void) {
+    struct intsmallvec vec = {0};
+    for(int i = 0; i < 3; i++) {
+        intsmallvec_push(&vec, i);
+        intsmallvec_push_unique(&vec, i);
+    }
+    assert(vec.length == 3 && NULL == vec.heap);
+    for(int i = 3; i < 100; i++) {
+        intsmallvec_push(&vec, i);
+        intsmallvec_push_unique(&vec, i);
+    }
+    assert(vec.length == 100 && NULL != vec.heap);
+    for(int i = 0; i < 100; i++) {
+        assert(intsmallvec_items(&vec)[i] == i);
+    }
+    assert(NULL == intsmallvec_find(&vec, 100));
+    intsmallvec_free(&vec);
+    assert(vec.length == 0 && NULL == vec.heap);
+
+    struct pairsmallvec pairs = {0};
+    pairsmallvec_push(&pairs, (struct pair){1, 2});
+    struct pair *found = pairsmallvec_find(&pairs, (struct pair){1, 2});
+    assert(found == pairs.inline_items);
+    pairsmallvec_push(&pairs, (struct pair){3, 4});
+    assert(NULL != pairs.heap && pairsmallvec_items(&pairs)[1].b == 4);
+    pairsmallvec_free(&pairs);
+}
+
+#define bench(name, N, ...)                                                    \
+    {                                                                          \
+        printf("%-22s ", name);                                                \
+        clock_t begin = clock();                                               \
+        for(int i = 0; i < N; i++) {                                           \
+            __VA_ARGS__;                                                       \
+        }                                                                      \
+        clock_t end = clock();                                                 \
+        double elapsed_secs = (double)(end - begin) / CLOCKS_PER_SEC;          \
+        printf("%d ops in %.3f secs, %.2f ns/op\n", N, elapsed_secs,           \
+               elapsed_secs / (double)N * 1e9);                                \
+    }
+
+static void benchmarks(void) {
+    int N = getenv("N") ? atoi(getenv("N")) : 10000000;
+    printf("count=%d\n", N);
+
+    struct vector *generic = vector_init(sizeof(void *));
+    bench("push (vector, ptr)", N, {
+        void *item = &generic[i & 1];
+        vector_push(generic, &item);
+    });
+    vector_free(generic);
+
+    struct ptrvec ptrs = {0};
+    bench("push (typed, ptr)", N, {
+        ptrvec_push(&ptrs, &ptrs + (i & 1));
+    });
+    ptrvec_free(&ptrs);
+
+    generic = vector_init(sizeof(struct pair));
+    bench("push (vector, 16B)", N, {
+        struct pair item = {i, ~(uint64_t)i};
+        vector_push(generic, &item);
+    });
+    vector_free(generic);
+
+    struct pairvec pairs = {0};
+    bench("push (typed, 16B)", N, {
+        pairvec_push(&pairs, (struct pair){i, ~(uint64_t)i});
+    });
+
+    uint64_t sum = 0;
+    bench("read (typed, 16B)", N, { sum += pairs.items[i].a; });
+    bench("pop (typed, 16B)", N, { sum += pairvec_pop(&pairs).b; });
+    pairvec_free(&pairs);
+    printf("checksum %llu\n", (unsigned long long)sum);
+
+    struct uvector *uvec = uvector_init(sizeof(int), NULL, NULL);
+    int unique = N / 10;
+    bench("push_unique (uvector)", unique,
+          { uvector_push_unique(uvec, &i); });
+    uvector_free(uvec);
+
+    generic = vector_init(sizeof(int));
+    unique = unique > 20000 ? 20000 : unique;
+    bench("push_unique (vector)", unique,
+          { vector_push_unique(generic, &i); });
+    vector_free(generic);
+}
+
+int main(void) {
+    if(getenv("BENCH")) {
+        printf("Running vector.c benchmarks...\n");
+        benchmarks();
+    } else {
+        printf("Running vector.c tests...\n");
+        test_typed();
+        test_unique();
+        test_small();
+        printf("PASSED\n");
+    }
+}
+
+#endif
@@ -1,7 +1,15 @@
 #ifndef VECTOR_H
 #define VECTOR_H
 
+#include <stddef.h>
+#include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
+
+// The capacity of a vector's first allocation.
+#ifndef VECTOR_DEFAULT_CAPACITY
+#define VECTOR_DEFAULT_CAPACITY 4
+#endif
 
 struct vector {
     char *items;
@@ -16,4 +24,161 @@ void *vector_push_unique(struct vector *vec, const void *item);
 void *vector_find(const struct vector *vec, const void *item);
 void vector_free(struct vector *vec);
 
+// A vector of distinct items, in insertion order. Short vectors are searched
+// linearly; past UVECTOR_INDEX_THRESHOLD items, an open-addressing index of
+// item numbers is built and kept up to date, so lookups stay O(1) expected.
+// The callbacks have the same signatures as the hashmap's (the seeds are 0
+// and udata is NULL), and NULL means comparing the items' bytes.
+#ifndef UVECTOR_INDEX_THRESHOLD
+#define UVECTOR_INDEX_THRESHOLD 8
+#endif
+
+struct uvector {
+    struct vector vec;
+    uint32_t *index; // item number + 1 in every used slot, NULL until built
+    size_t index_slots;
+    uint64_t (*hash)(const void *item, uint64_t seed0, uint64_t seed1);
+    int (*compare)(const void *a, const void *b, void *udata);
+};
+
+struct uvector *uvector_init(size_t item_size,
+                             uint64_t (*hash)(const void *item, uint64_t seed0,
+                                              uint64_t seed1),
+                             int (*compare)(const void *a, const void *b,
+                                            void *udata));
+void *uvector_push_unique(struct uvector *uvec, const void *item);
+void *uvector_find(const struct uvector *uvec, const void *item);
+void uvector_free(struct uvector *uvec);
+
+// Declares `struct name`, a vector of `type`, along with its functions. Unlike
+// struct vector, the item size is known at compile time, so pushing is a plain
+// assignment that the compiler can inline. Declare it once per type, at file
+// scope; a zeroed struct is an empty vector.
+// The vector only grows when it must: reserve allocates exactly what's asked
+// for, and the other functions at least double the capacity (or grow to fit,
+// if that's more) so that pushing stays amortized O(1).
+#define VECTOR_DEFINE(name, type)                                              \
+    struct name {                                                              \
+        type *items;                                                           \
+        size_t length;                                                         \
+        size_t capacity;                                                       \
+    };                                                                         \
+                                                                               \
+    static inline void name##_reserve(struct name *vec, size_t capacity) {     \
+        if(capacity > vec->capacity) {                                         \
+            vec->items = realloc(vec->items, capacity * sizeof(type));         \
+            vec->capacity = capacity;                                          \
+        }                                                                      \
+    }                                                                          \
+                                                                               \
+    static inline void name##_grow(struct name *vec, size_t needed) {          \
+        if(needed > vec->capacity) {                                           \
+            size_t capacity = vec->capacity == 0 ? VECTOR_DEFAULT_CAPACITY     \
+                                                 : 2 * vec->capacity;          \
+            name##_reserve(vec, capacity > needed ? capacity : needed);        \
+        }                                                                      \
+    }                                                                          \
+                                                                               \
+    static inline type *name##_push(struct name *vec, type item) {             \
+        name##_grow(vec, vec->length + 1);                                     \
+        vec->items[vec->length] = item;                                        \
+        return &vec->items[vec->length++];                                     \
+    }                                                                          \
+                                                                               \
+    /* the vector must not be empty. */                                        \
+    static inline type name##_pop(struct name *vec) {                          \
+        return vec->items[--vec->length];                                      \
+    }                                                                          \
+                                                                               \
+    /* moves the items from position onwards up by one. */                     \
+    static inline type *name##_insert(struct name *vec, size_t position,       \
+                                      type item) {                             \
+        name##_grow(vec, vec->length + 1);                                     \
+        memmove(&vec->items[position + 1], &vec->items[position],              \
+                (vec->length - position) * sizeof(type));                      \
+        vec->items[position] = item;                                           \
+        vec->length++;                                                         \
+        return &vec->items[position];                                          \
+    }                                                                          \
+                                                                               \
+    /* removes `count` items starting at position, keeping the order. */       \
+    static inline void name##_erase(struct name *vec, size_t position,         \
+                                    size_t count) {                            \
+        memmove(&vec->items[position], &vec->items[position + count],          \
+                (vec->length - position - count) * sizeof(type));              \
+        vec->length -= count;                                                  \
+    }                                                                          \
+                                                                               \
+    static inline void name##_append(struct name *vec, const type *items,      \
+                                     size_t count) {                           \
+        if(count == 0) {                                                       \
+            return;                                                            \
+        }                                                                      \
+        name##_grow(vec, vec->length + count);                                 \
+        memcpy(&vec->items[vec->length], items, count * sizeof(type));         \
+        vec->length += count;                                                  \
+    }                                                                          \
+                                                                               \
+    static inline void name##_free(struct name *vec) {                         \
+        free(vec->items);                                                      \
+        vec->items = NULL;                                                     \
+        vec->length = 0;                                                       \
+        vec->capacity = 0;                                                     \
+    }
+
+// Declares `struct name`, a vector of `type` that keeps its first
+// `inline_count` items (at least 1) inside the struct itself, and only moves
+// them to the heap once they don't fit. It's meant to be embedded in other
+// structs (or arrays), so a zeroed struct is an empty vector, and free only
+// releases the items that were moved. Pick `inline_count` so that most
+// vectors fit: every struct pays for it, used or not. Like struct vector's,
+// find compares the items' bytes.
+#define SMALLVEC_DEFINE(name, type, inline_count)                              \
+    struct name {                                                              \
+        type *heap; /* NULL while the items are inline */                      \
+        size_t length;                                                         \
+        size_t capacity; /* of the heap */                                     \
+        type inline_items[inline_count];                                       \
+    };                                                                         \
+                                                                               \
+    static inline type *name##_items(struct name *vec) {                       \
+        return NULL != vec->heap ? vec->heap : vec->inline_items;              \
+    }                                                                          \
+                                                                               \
+    static inline type *name##_push(struct name *vec, type item) {             \
+        if(NULL == vec->heap && vec->length == (inline_count)) {               \
+            vec->capacity = 2 * (inline_count);                                \
+            vec->heap = malloc(vec->capacity * sizeof(type));                  \
+            memcpy(vec->heap, vec->inline_items, sizeof(vec->inline_items));   \
+        } else if(NULL != vec->heap && vec->length == vec->capacity) {         \
+            vec->capacity *= 2;                                                \
+            vec->heap = realloc(vec->heap, vec->capacity * sizeof(type));      \
+        }                                                                      \
+        type *items = name##_items(vec);                                       \
+        items[vec->length] = item;                                             \
+        return &items[vec->length++];                                          \
+    }                                                                          \
+                                                                               \
+    static inline type *name##_find(struct name *vec, type item) {             \
+        type *items = name##_items(vec);                                       \
+        for(size_t i = 0; i < vec->length; i++) {                              \
+            if(0 == memcmp(&items[i], &item, sizeof(type))) {                  \
+                return &items[i];                                              \
+            }                                                                  \
+        }                                                                      \
+        return NULL;                                                           \
+    }                                                                          \
+                                                                               \
+    static inline type *name##_push_unique(struct name *vec, type item) {      \
+        type *found = name##_find(vec, item);                                  \
+        return NULL != found ? found : name##_push(vec, item);                 \
+    }                                                                          \
+                                                                               \
+    static inline void name##_free(struct name *vec) {                         \
+        free(vec->heap);                                                       \
+        vec->heap = NULL;                                                      \
+        vec->length = 0;                                                       \
+        vec->capacity = 0;                                                     \
+    }
+
 #endif // VECTOR_H
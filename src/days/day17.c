@@ -1,11 +1,12 @@
 #include "aoc20.h"
 #include "hashmap.h"
+#include "hashmap_gen.h"
 
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
-
-typedef struct hashmap hashmap;
+#include <string.h>
 
 typedef union point4 {
     struct {
@@ -18,34 +19,34 @@ typedef union point4 {
     int co[4];
 } point4;
 
+static inline uint64_t point4_hash(const point4 *p);
+static inline bool point4_equal(const point4 *a, const point4 *b);
+
+// the map is specialized for points, so that the tens of millions of lookups
+// in count_neighbors don't call the hash and equality through pointers.
+HASHMAP_DEFINE(pointmap, point4, point4_hash, point4_equal)
+typedef struct pointmap pointmap;
+
 typedef struct minmax_info {
     point4 min;
     point4 max;
 } minmax_info;
 
-static void handle_input(hashmap *map, minmax_info *mm);
-static void advance_simulation(hashmap *map, minmax_info *mm, bool is_4d);
-static int count_neighbors(hashmap *map, const point4 *p, bool is_4d);
+static void handle_input(pointmap *map, minmax_info *mm);
+static void advance_simulation(pointmap *map, minmax_info *mm, bool is_4d);
+static int count_neighbors(pointmap *map, const point4 *p, bool is_4d);
 static void update_minmax(minmax_info *mm, const point4 *p, bool is_4d);
 static void day17_doer(bool is_4d);
 
-static int point4_compare(const void *a_void, const void *b_void, void *udata) {
-    const point4 *a = a_void;
-    const point4 *b = b_void;
-
-    for(int i = 0; i < 4; i++) {
-        int comp = (a->co[i] > b->co[i]) - (a->co[i] < b->co[i]);
-
-        if(comp) {
-            return comp;
-        }
-    }
-
-    return 0;
+static inline uint64_t point4_hash(const point4 *p) {
+    uint64_t low, high;
+    memcpy(&low, &p->co[0], sizeof(low));
+    memcpy(&high, &p->co[2], sizeof(high));
+    return hashmap_mix128(low, high, 0);
 }
 
-static uint64_t point4_hash(const void *item, uint64_t seed0, uint64_t seed1) {
-    return hashmap_sip(item, sizeof(point4), seed0, seed1);
+static inline bool point4_equal(const point4 *a, const point4 *b) {
+    return a->x == b->x && a->y == b->y && a->z == b->z && a->w == b->w;
 }
 
 void day17() {
@@ -57,8 +58,7 @@ void day17() {
 static void day17_doer(bool is_4d) {
     printf("Day 17 - Part %d\n", is_4d ? 2 : 1);
 
-    hashmap *simulation =
-        hashmap_new(sizeof(point4), 0, 0, 0, point4_hash, point4_compare, NULL);
+    pointmap *simulation = pointmap_new(0);
 
     minmax_info minmax = {{{0, 0, 0, 0}}, {{0, 0, 0, 0}}};
     handle_input(simulation, &minmax);
@@ -68,25 +68,23 @@ static void day17_doer(bool is_4d) {
     }
 
     printf("The number of active cells after 6 iterations: %zu\n",
-           hashmap_count(simulation));
+           pointmap_count(simulation));
 
-    hashmap_free(simulation);
+    pointmap_free(simulation);
 }
 
-static bool copy_iter(const void *item, void *udata) {
-    hashmap *copy = udata;
+static bool copy_iter(const point4 *item, void *udata) {
+    pointmap *copy = udata;
 
-    // the cast is fine, because there is no modification
-    hashmap_set(copy, (void *)item);
+    pointmap_set(copy, item);
 
     return true;
 }
 
-static void advance_simulation(hashmap *map, minmax_info *mm, bool is_4d) {
-    hashmap *copy =
-        hashmap_new(sizeof(point4), 0, 0, 0, point4_hash, point4_compare, NULL);
+static void advance_simulation(pointmap *map, minmax_info *mm, bool is_4d) {
+    pointmap *copy = pointmap_new(pointmap_count(map));
 
-    hashmap_scan(map, copy_iter, copy);
+    pointmap_scan(map, copy_iter, copy);
 
     // the checks on min/max w are done to ensure that w's for loop
     // only has w=0.
@@ -104,13 +102,13 @@ static void advance_simulation(hashmap *map, minmax_info *mm, bool is_4d) {
                     // update P and possibly minmax bounds
 
                     point4 p = {.x = x, .y = y, .z = z, .w = w};
-                    bool active = hashmap_get(copy, &p) != NULL;
+                    bool active = pointmap_get(copy, &p) != NULL;
                     int neighbors = count_neighbors(copy, &p, is_4d);
 
                     if(active && neighbors != 2 && neighbors != 3) {
-                        hashmap_delete(map, &p);
+                        pointmap_delete(map, &p);
                     } else if(!active && neighbors == 3) {
-                        hashmap_set(map, &p);
+                        pointmap_set(map, &p);
                         update_minmax(mm, &p, is_4d);
                     }
                 }
@@ -118,7 +116,7 @@ static void advance_simulation(hashmap *map, minmax_info *mm, bool is_4d) {
         }
     }
 
-    hashmap_free(copy);
+    pointmap_free(copy);
 }
 
 static void update_minmax(minmax_info *mm, const point4 *p, bool is_4d) {
@@ -133,42 +131,33 @@ static void update_minmax(minmax_info *mm, const point4 *p, bool is_4d) {
     }
 }
 
-static int count_neighbors(hashmap *map, const point4 *p, bool is_4d) {
-    int x = p->x, y = p->y, z = p->z, w = p->w, counter = 0;
+// the neighbors are looked up in one batch, so that the misses overlap.
+static int count_neighbors(pointmap *map, const point4 *p, bool is_4d) {
+    point4 neighbors[80];
+    size_t n = 0;
+    int minw = is_4d ? -1 : 0, maxw = is_4d ? 1 : 0;
 
     for(int dx = -1; dx <= 1; dx++) {
         for(int dy = -1; dy <= 1; dy++) {
             for(int dz = -1; dz <= 1; dz++) {
-                if(is_4d) {
-                    for(int dw = -1; dw <= 1; dw++) {
-                        if(dx == 0 && dy == 0 && dz == 0 && dw == 0) {
-                            continue;
-                        }
-
-                        point4 temp = {
-                            .x = x + dx, .y = y + dy, .z = z + dz, .w = w + dw};
-                        if(hashmap_get(map, &temp) != NULL) {
-                            counter += 1;
-                        }
-                    }
-                } else {
-                    if(dx == 0 && dy == 0 && dz == 0) {
+                for(int dw = minw; dw <= maxw; dw++) {
+                    if(dx == 0 && dy == 0 && dz == 0 && dw == 0) {
                         continue;
                     }
-                    point4 temp = {
-                        .x = x + dx, .y = y + dy, .z = z + dz, .w = w};
-                    if(hashmap_get(map, &temp) != NULL) {
-                        counter += 1;
-                    }
+
+                    neighbors[n++] = (point4){.x = p->x + dx,
+                                              .y = p->y + dy,
+                                              .z = p->z + dz,
+                                              .w = p->w + dw};
                 }
             }
         }
     }
 
-    return counter;
+    return pointmap_get_many(map, neighbors, n, NULL);
 }
 
-static void handle_input(hashmap *map, minmax_info *mm) {
+static void handle_input(pointmap *map, minmax_info *mm) {
     FILE *input = fopen("inputs/day17.txt", "r");
     if(input == NULL) {
         perror("Error opening day17.txt");
@@ -184,7 +173,7 @@ static void handle_input(hashmap *map, minmax_info *mm) {
         } else {
             if(ch == '#') {
                 point4 p = {.x = i, .y = j, .z = 0, .w = 0};
-                hashmap_set(map, &p);
+                pointmap_set(map, &p);
 
                 if(mm->max.x < i) {
                     mm->max.x = i;
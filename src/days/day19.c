@@ -1,6 +1,7 @@
 #include "aoc20.h"
 #include "dynarr.h"
 #include "hashmap.h"
+#include "vector.h"
 
 #include <ctype.h>
 #include <stdbool.h>
@@ -8,13 +9,63 @@
 #include <stdlib.h>
 #include <string.h>
 
+#ifdef DAY19_PROFILE
+#include <time.h>
+#endif
+
+#ifdef DAY19_GENERATED
+// generated by bldgen.sh, see DAY19_GEN at the end of this file.
+#include "day19_matchers.h"
+#endif
+
 typedef struct dynarr dynarr;
 typedef struct hashmap hashmap;
+typedef struct vector vector_t;
+
+// rules whose language has more strings than this are not enumerated.
+#define LANGUAGE_LIMIT 4096
+// messages that would need a bigger chart than this only use the cache.
+#define CHART_LIMIT (64 << 20)
+
+// a 256-bit mask of characters, one bit per possible byte value.
+struct charset {
+    uint64_t bits[4];
+};
+
+// a string that isn't necessarily null terminated.
+struct chunk {
+    const char *str;
+    size_t len;
+};
+
+// the complete (finite) set of strings matched by a non-recursive rule.
+struct language {
+    struct uvector *chunks; // the strings are owned by the language
+    size_t len;       // the length shared by every string, or 0 if they differ
+};
 
-enum rulekind { BASIC, COMPOUND };
+// UNUSED is for rule numbers that don't appear in the input, or that were
+// removed by optimize_rules.
+enum rulekind { UNUSED, BASIC, COMPOUND };
+// recursive rules that can be matched chunk by chunk using the languages of
+// the rules they repeat.
+enum ruleshape {
+    SHAPE_NONE,
+    SHAPE_REPEAT, // x: a | a x
+    SHAPE_NEST,   // x: a b | a x b
+};
 struct rule {
     int num;
     enum rulekind kind;
+    // the characters that a string matched by this rule can start/end with.
+    // filled in by analyze_rules.
+    struct charset first;
+    struct charset last;
+    // filled in by build_languages. lang is NULL if the rule is recursive
+    // or its language is too large.
+    struct language *lang;
+    enum ruleshape shape;
+    int shape_a, shape_b;
     union {
         struct {
             char ch;
@@ -24,11 +75,171 @@ struct rule {
         } compound;
     };
 };
+// the parts of a rule that the matchers need. see struct ruletable.
+struct flatrule {
+    enum rulekind kind;
+    char ch;
+    enum ruleshape shape;
+    int shape_a, shape_b;
+    struct charset first;
+    struct charset last;
+    const struct language *lang;
+};
+
+// every rule, laid out contiguously in a single allocation so that matching
+// doesn't have to chase pointers through nested dynarrs.
+// the options of rule r are numbered option_start[r] up to (excluding)
+// option_start[r + 1], and the elements of option o are elems[elem_start[o]]
+// up to elems[elem_start[o + 1]].
+// built by build_ruletable once the rules are final, freed with free().
+struct ruletable {
+    size_t rules_len;
+    struct flatrule *rules;
+    uint32_t *option_start;
+    uint32_t *elem_start;
+    int *elems;
+};
+
 struct span {
     char *base;
     size_t start;
     size_t end;
 };
+static bool charset_has(const struct charset *set, char ch) {
+    unsigned char uch = ch;
+    return (set->bits[uch / 64] >> (uch % 64)) & 1;
+}
+
+static void charset_add(struct charset *set, char ch) {
+    unsigned char uch = ch;
+    set->bits[uch / 64] |= (uint64_t)1 << (uch % 64);
+}
+
+// adds every character in src to dst. returns true if dst has changed.
+static bool charset_union(struct charset *dst, const struct charset *src) {
+    bool changed = false;
+    for(int i = 0; i < 4; i++) {
+        uint64_t merged = dst->bits[i] | src->bits[i];
+        if(merged != dst->bits[i]) {
+            dst->bits[i] = merged;
+            changed = true;
+        }
+    }
+    return changed;
+}
+
+static int chunk_compare(const void *a_void, const void *b_void, void *udata) {
+    const struct chunk *a = a_void;
+    const struct chunk *b = b_void;
+
+    if(a->len != b->len) {
+        return (a->len > b->len) - (a->len < b->len);
+    }
+    return memcmp(a->str, b->str, a->len);
+}
+
+static uint64_t chunk_hash(const void *vitem, uint64_t seed0, uint64_t seed1) {
+    const struct chunk *item = vitem;
+    return hashmap_wyhash(item->str, item->len, seed0, seed1);
+}
+
+// a per-message memo, indexed by rule, span start and span length. only the
+// rules that reach it (the ones that are neither enumerated nor shaped) get a
+// row. moving to the next message only bumps the epoch: a cell holds the
+// epoch it was written in (shifted left by one) and the result in its lowest
+// bit. since the epoch keeps going up, the cells can be reused for messages
+// of another length without clearing them.
+// the cells are NULL when the chart would be too big, and then every rule
+// goes straight to the cache.
+struct chart {
+    int *rows;        // a rule's row, or -1 if it doesn't have one
+    size_t rows_len;
+    size_t len;
+    uint16_t epoch;
+    uint16_t *cells;
+    size_t cells_len;
+};
+
+static struct chart chart_new(const struct ruletable *table) {
+    struct chart chart = {.rows = malloc(table->rules_len * sizeof(int))};
+    if(chart.rows == NULL) {
+        return chart;
+    }
+    for(size_t i = 0; i < table->rules_len; i++) {
+        const struct flatrule *rule = &table->rules[i];
+        bool charted = rule->kind != UNUSED && rule->lang == NULL &&
+                       rule->shape == SHAPE_NONE;
+        chart.rows[i] = charted ? (int)chart.rows_len++ : -1;
+    }
+    return chart;
+}
+
+static void chart_free(struct chart *chart) {
+    free(chart->rows);
+    free(chart->cells);
+}
+
+// makes room for messages of length len. the cells only grow, doubling so
+// that a run of ever longer messages doesn't allocate each time.
+static void chart_resize(struct chart *chart, size_t len) {
+    chart->len = len;
+    size_t needed = len * len;
+    if(chart->rows == NULL || (len != 0 && needed / len != len) ||
+       needed > CHART_LIMIT / sizeof(uint16_t) / (chart->rows_len + 1)) {
+        chart->len = 0;
+        return;
+    }
+    needed *= chart->rows_len;
+    if(chart->cells != NULL && needed <= chart->cells_len) {
+        return;
+    }
+
+    free(chart->cells);
+    chart->cells_len = needed < chart->cells_len * 2 ? chart->cells_len * 2
+                                                     : needed;
+    chart->cells = calloc(chart->cells_len, sizeof(uint16_t));
+    if(chart->cells == NULL) {
+        chart->cells_len = 0;
+        chart->len = 0;
+    }
+}
+
+// forgets everything about the previous message.
+static void chart_next(struct chart *chart) {
+    if(chart->epoch == UINT16_MAX >> 1) {
+        if(chart->cells != NULL) {
+            memset(chart->cells, 0, chart->cells_len * sizeof(uint16_t));
+        }
+        chart->epoch = 0;
+    }
+    chart->epoch += 1;
+}
+
+// returns NULL if the rule or the message isn't charted.
+static uint16_t *chart_cell(struct chart *chart, int rulenum, size_t start,
+                            size_t end) {
+    if(chart->len == 0 || chart->rows[rulenum] < 0) {
+        return NULL;
+    }
+    size_t row = chart->rows[rulenum];
+    return &chart->cells[(row * chart->len + start) * chart->len +
+                         (end - start - 1)];
+}
+
+// all of the messages, in one buffer. duplicates are stored once along with
+// the number of times they appear, and they're sorted by length so that
+// messages of the same length are next to each other.
+struct message {
+    const char *str;
+    size_t len;
+    int count;
+};
+struct msgbatch {
+    char *buf;
+    struct message *msgs;
+    size_t msgs_len;
+};
+
 typedef struct cached_result {
     int rulenum;
     struct span span;
@@ -67,36 +278,209 @@ static uint64_t cached_hash(const void *vitem, uint64_t seed0, uint64_t seed1) {
     const cached_result *item = vitem;
     size_t len = item->span.end - item->span.start;
 
-    return hashmap_sip(item->span.base + item->span.start, len * sizeof(char),
-                       seed0, seed1);
+    return hashmap_wyhash(item->span.base + item->span.start,
+                          len * sizeof(char), seed0, seed1);
+}
+
+//==============================================================================
+// PROFILING
+// Building with -DDAY19_PROFILE records, for every rule, how matches_rule was
+// resolved and how long it took, and prints a table of it after each part.
+// If DAY19_PROFILE_CSV is set in the environment, the same rows are appended
+// to the file it names. Without the flag, the PROFILE_ macros do nothing.
+//==============================================================================
+#ifdef DAY19_PROFILE
+
+struct rulestats {
+    uint64_t calls;  // calls to matches_rule
+    uint64_t pruned; // rejected by the FIRST/LAST sets
+    uint64_t fast;   // answered by the rule's language or shape
+    uint64_t hits;   // answered by the chart or the cache
+    uint64_t misses; // had to go through matches_rule_int
+    uint64_t splits; // split candidates tried in iterate_with_counters
+    uint64_t nanos;  // time spent in matches_rule_int, counted once for
+                     // recursive rules
+    int depth;
+};
+
+static struct {
+    struct rulestats *rules;
+    size_t rules_len;
+    size_t peak_memo;
+    int current; // the rule whose options are being matched, or -1
+} profile;
+
+static uint64_t profile_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static void profile_start(size_t rules_len) {
+    free(profile.rules);
+    profile.rules = calloc(rules_len, sizeof(struct rulestats));
+    profile.rules_len = rules_len;
+    profile.peak_memo = 0;
+    profile.current = -1;
+}
+
+static void profile_memo_size(size_t size) {
+    if(size > profile.peak_memo) {
+        profile.peak_memo = size;
+    }
+}
+
+// the time each rule spent, sorted from slowest.
+static int profile_compare(const void *a_void, const void *b_void) {
+    const struct rulestats *a = &profile.rules[*(const int *)a_void];
+    const struct rulestats *b = &profile.rules[*(const int *)b_void];
+    return (a->nanos < b->nanos) - (a->nanos > b->nanos);
+}
+
+static void profile_report(const char *title) {
+    int *order = calloc(profile.rules_len, sizeof(int));
+    for(size_t i = 0; i < profile.rules_len; i++) {
+        order[i] = i;
+    }
+    qsort(order, profile.rules_len, sizeof(int), profile_compare);
+
+    const char *csv_path = getenv("DAY19_PROFILE_CSV");
+    FILE *csv = csv_path != NULL ? fopen(csv_path, "a") : NULL;
+
+    printf("\nProfile (%s), peak memo size: %zu\n", title, profile.peak_memo);
+    printf("%6s %10s %10s %10s %10s %10s %10s %10s\n", "rule", "calls",
+           "pruned", "fast", "hits", "misses", "splits", "ms");
+    for(size_t i = 0; i < profile.rules_len; i++) {
+        const struct rulestats *stats = &profile.rules[order[i]];
+        if(stats->calls == 0) {
+            continue;
+        }
+
+        printf("%6d %10llu %10llu %10llu %10llu %10llu %10llu %10.3f\n",
+               order[i], (unsigned long long)stats->calls,
+               (unsigned long long)stats->pruned,
+               (unsigned long long)stats->fast,
+               (unsigned long long)stats->hits,
+               (unsigned long long)stats->misses,
+               (unsigned long long)stats->splits, stats->nanos / 1e6);
+        if(csv != NULL) {
+            fprintf(csv, "%s,%d,%llu,%llu,%llu,%llu,%llu,%llu,%llu,%zu\n",
+                    title, order[i], (unsigned long long)stats->calls,
+                    (unsigned long long)stats->pruned,
+                    (unsigned long long)stats->fast,
+                    (unsigned long long)stats->hits,
+                    (unsigned long long)stats->misses,
+                    (unsigned long long)stats->splits,
+                    (unsigned long long)stats->nanos, profile.peak_memo);
+        }
+    }
+    printf("\n");
+
+    if(csv != NULL) {
+        fclose(csv);
+    }
+    free(order);
 }
 
-static void parse(struct rule **rules, size_t *rules_len, char ***msgs,
-                  size_t *msgs_len);
+#define PROFILE_START(rules_len) profile_start(rules_len)
+#define PROFILE_REPORT(title) profile_report(title)
+#define PROFILE_COUNT(rulenum, field) (profile.rules[rulenum].field += 1)
+#define PROFILE_SPLIT()                                                        \
+    {                                                                          \
+        if(profile.current != -1) {                                            \
+            profile.rules[profile.current].splits += 1;                        \
+        }                                                                      \
+    }
+#define PROFILE_MEMO_SIZE(size) profile_memo_size(size)
+// wraps a call to matches_rule_int
+#define PROFILE_MISS(rulenum, call)                                            \
+    {                                                                          \
+        struct rulestats *stats = &profile.rules[rulenum];                     \
+        int previous = profile.current;                                        \
+        uint64_t started = stats->depth == 0 ? profile_now() : 0;              \
+        stats->misses += 1;                                                    \
+        stats->depth += 1;                                                     \
+        profile.current = rulenum;                                             \
+        call;                                                                  \
+        profile.current = previous;                                            \
+        stats->depth -= 1;                                                     \
+        if(stats->depth == 0) {                                                \
+            stats->nanos += profile_now() - started;                           \
+        }                                                                      \
+    }
+
+#else
+
+#define PROFILE_START(rules_len)
+#define PROFILE_REPORT(title)
+#define PROFILE_COUNT(rulenum, field)
+#define PROFILE_SPLIT()
+#define PROFILE_MEMO_SIZE(size)
+#define PROFILE_MISS(rulenum, call) call
+
+#endif // DAY19_PROFILE
+
+static void parse(const char *path, struct rule **rules, size_t *rules_len,
+                  struct msgbatch *batch);
 static size_t lines_until_empty(FILE *file);
 static struct rule parse_rule(const char *line);
 static bool matches_rule(const struct span span, int rulenum,
-                         const struct rule *rules, hashmap *cachemap);
+                         const struct ruletable *table, hashmap *cachemap,
+                         struct chart *chart);
 static int count_pipes(const char *str);
 static void populate_rule_arr(dynarr *intarr, const char *line);
-
-static int count_matching_rules(const struct rule *rules, size_t rules_len,
-                                char **msgs, size_t msgs_len,
+static void analyze_rules(struct rule *rules, size_t rules_len,
+                          const bool *dirty);
+static void build_languages(struct rule *rules, size_t rules_len,
+                            const bool *dirty);
+static void free_language(struct language *lang);
+static void update_rules(struct rule *rules, size_t rules_len,
+                         const char *const *lines, size_t lines_len,
+                         hashmap *cachemap);
+static void optimize_rules(struct rule **rules, size_t *rules_len,
+                           const int *pinned, size_t pinned_len);
+static struct ruletable *build_ruletable(const struct rule *rules,
+                                         size_t rules_len);
+#if defined(DAY19_GEN) || defined(DAY19_GENERATED)
+static uint64_t rules_fingerprint(const struct rule *rules, size_t rules_len);
+#endif
+
+// part 2 replaces 8 and 11 with rules that refer to 42 and 31, so all of
+// them need to keep their numbers and meaning.
+static const int pinned_rules[] = {0, 8, 11, 31, 42};
+static const char *const part2_rules[] = {"8: 42 | 42 8\n",
+                                          "11: 42 31 | 42 11 31\n"};
+
+static int count_matching_rules(const struct ruletable *table,
+                                const struct msgbatch *batch,
                                 hashmap *cachemap) {
     int counter = 0;
-    for(size_t i = 0; i < msgs_len; i++) {
-        printf("\rMessages left: %zu ", msgs_len - i);
-        char *msg = msgs[i];
-        struct span span = {.base = msg, .start = 0, .end = strlen(msg)};
+    struct chart chart = chart_new(table);
+    for(size_t i = 0; i < batch->msgs_len; i++) {
+        printf("\rMessages left: %zu ", batch->msgs_len - i);
+        const struct message *msg = &batch->msgs[i];
 
-        if(matches_rule(span, 0, rules, cachemap)) {
-            counter += 1;
+        if(i == 0 || msg->len != batch->msgs[i - 1].len) {
+            chart_resize(&chart, msg->len);
+        }
+        chart_next(&chart);
+
+        // the span doesn't modify the message, it just can't be const.
+        struct span span = {
+            .base = (char *)msg->str, .start = 0, .end = msg->len};
+        if(matches_rule(span, 0, table, cachemap, &chart)) {
+            counter += msg->count;
         }
     }
+
+    chart_free(&chart);
     return counter;
 }
 
 static void free_rule(struct rule *rule) {
+    free_language(rule->lang);
+    rule->lang = NULL;
+
     if(rule->kind == COMPOUND) {
         dynarr *arrays = rule->compound.arrays;
         dynarr *intarrays = arrays->elems;
@@ -111,39 +495,83 @@ static void free_rule(struct rule *rule) {
     }
 }
 
-void day19() {
-    struct rule *rules = NULL;
-    size_t rules_len = 0;
-    char **msgs = NULL;
-    size_t msgs_len = 0;
-    parse(&rules, &rules_len, &msgs, &msgs_len);
+#ifdef DAY19_GENERATED
+static int count_generated(const struct msgbatch *batch,
+                           bool (*matches)(const char *, size_t)) {
+    int counter = 0;
+    for(size_t i = 0; i < batch->msgs_len; i++) {
+        const struct message *msg = &batch->msgs[i];
+        if(matches(msg->str, msg->len)) {
+            counter += msg->count;
+        }
+    }
+    return counter;
+}
+
+// the matchers were compiled in, so only the messages are needed.
+static void solve_generated(const struct msgbatch *batch) {
+    printf("Using the generated matchers.\n");
+    printf("Day 19 - Part 1\n");
+    printf("Valid messages: %d\n\n", count_generated(batch, day19_gen_part1));
+    printf("Day 19 - Part 2\n");
+    printf("Valid messages: %d\n", count_generated(batch, day19_gen_part2));
+}
+#endif
+
+static void solve_interpreted(struct rule **rules, size_t *rules_len,
+                              const struct msgbatch *batch) {
+    optimize_rules(rules, rules_len, pinned_rules, 5);
+    analyze_rules(*rules, *rules_len, NULL);
+    build_languages(*rules, *rules_len, NULL);
+    struct ruletable *table = build_ruletable(*rules, *rules_len);
 
     hashmap *cachemap = hashmap_new(sizeof(cached_result), 0, 0, 0, cached_hash,
                                     cached_compare, NULL);
 
+    PROFILE_START(table->rules_len);
     printf("Day 19 - Part 1\n");
     printf("\rValid messages: %d\n\n",
-           count_matching_rules(rules, rules_len, msgs, msgs_len, cachemap));
+           count_matching_rules(table, batch, cachemap));
+    PROFILE_REPORT("part 1");
 
-    hashmap_clear(cachemap, false);
-    free_rule(&rules[8]);
-    free_rule(&rules[11]);
-    rules[8] = parse_rule("8: 42 | 42 8\n");
-    rules[11] = parse_rule("11: 42 31 | 42 11 31\n");
+    update_rules(*rules, *rules_len, part2_rules, 2, cachemap);
+    free(table);
+    table = build_ruletable(*rules, *rules_len);
+    PROFILE_START(table->rules_len);
     printf("Day 19 - Part 2\n");
     printf("\rValid messages: %d\n",
-           count_matching_rules(rules, rules_len, msgs, msgs_len, cachemap));
+           count_matching_rules(table, batch, cachemap));
+    PROFILE_REPORT("part 2");
+
+    free(table);
+    hashmap_free(cachemap);
+}
+
+void day19() {
+    struct rule *rules = NULL;
+    size_t rules_len = 0;
+    struct msgbatch batch;
+    parse("inputs/day19.txt", &rules, &rules_len, &batch);
 
-    for(size_t i = 0; i < msgs_len; i++) {
-        free(msgs[i]);
+#ifdef DAY19_GENERATED
+    // the generated matchers are only valid for the rules they were made from.
+    if(rules_fingerprint(rules, rules_len) == DAY19_GEN_FINGERPRINT) {
+        solve_generated(&batch);
+    } else {
+        printf("The generated matchers are out of date, ignoring them.\n");
+        solve_interpreted(&rules, &rules_len, &batch);
     }
-    free(msgs);
+#else
+    solve_interpreted(&rules, &rules_len, &batch);
+#endif
+
+    free(batch.buf);
+    free(batch.msgs);
     for(size_t i = 0; i < rules_len; i++) {
         struct rule *rule = &rules[i];
         free_rule(rule);
     }
     free(rules);
-    hashmap_free(cachemap);
 }
 
 static bool increment_counters(int *counters, const bool *constants,
@@ -180,9 +608,35 @@ static bool increment_counters(int *counters, const bool *constants,
 static bool iterate_with_counters(struct span span, const int *arr,
                                   int *counters, bool *constants,
                                   int first_nonconst, int last_nonconst, int n,
-                                  const struct rule *rules, hashmap *cachemap) {
+                                  const struct ruletable *table,
+                                  hashmap *cachemap, struct chart *chart) {
     struct span newspan = {.base = span.base};
     int sum = 0;
+
+    // reject the split early if any of its pieces starts or ends with a
+    // character its rule can never start or end with. this is much cheaper
+    // than going through the cache for every piece.
+    for(int i = 0; i < n; i++) {
+        const struct flatrule *rule = &table->rules[arr[i]];
+        size_t start = span.start + sum;
+        sum += counters[i] + 1;
+        size_t end = span.start + sum;
+        if(end > span.end) {
+            break;
+        }
+
+        if(constants != NULL &&
+           (!constants[i] || (i >= first_nonconst && i <= last_nonconst))) {
+            continue;
+        }
+
+        if(!charset_has(&rule->first, span.base[start]) ||
+           !charset_has(&rule->last, span.base[end - 1])) {
+            return false;
+        }
+    }
+
+    sum = 0;
     for(int i = 0; i < n; i++) {
         newspan.start = span.start + sum;
         sum += counters[i] + 1;
@@ -197,7 +651,7 @@ static bool iterate_with_counters(struct span span, const int *arr,
             continue;
         }
 
-        if(!matches_rule(newspan, arr[i], rules, cachemap)) {
+        if(!matches_rule(newspan, arr[i], table, cachemap, chart)) {
             return false;
         }
     }
@@ -205,12 +659,11 @@ static bool iterate_with_counters(struct span span, const int *arr,
     return true;
 }
 
-static bool matches_rule_list(const struct span span, dynarr *intarr,
-                              const struct rule *rules, hashmap *cachemap) {
-    int *arr = intarr->elems;
-    int n = intarr->len;
+static bool matches_rule_list(const struct span span, const int *arr, int n,
+                              const struct ruletable *table, hashmap *cachemap,
+                              struct chart *chart) {
     if(n == 1) {
-        return matches_rule(span, arr[0], rules, cachemap);
+        return matches_rule(span, arr[0], table, cachemap, chart);
     } else {
         bool result;
 
@@ -223,8 +676,8 @@ static bool matches_rule_list(const struct span span, dynarr *intarr,
         for(int i = 0; i < n; i++) {
             int ruleno = arr[i];
             counters[i] = 0;
-            constants[i] = rules[ruleno].kind == BASIC;
-            if(rules[ruleno].kind != BASIC) {
+            constants[i] = table->rules[ruleno].kind == BASIC;
+            if(table->rules[ruleno].kind != BASIC) {
                 last_nonconst = i;
                 if(first_nonconst == -1) {
                     first_nonconst = i;
@@ -241,15 +694,16 @@ static bool matches_rule_list(const struct span span, dynarr *intarr,
         }
 
         if(!iterate_with_counters(span, arr, counters, constants,
-                                  first_nonconst, last_nonconst, n, rules,
-                                  cachemap)) {
+                                  first_nonconst, last_nonconst, n, table,
+                                  cachemap, chart)) {
             result = false;
             goto ending;
         }
 
         while(true) {
-            if(iterate_with_counters(span, arr, counters, NULL, 0, 0, n, rules,
-                                     cachemap)) {
+            PROFILE_SPLIT();
+            if(iterate_with_counters(span, arr, counters, NULL, 0, 0, n, table,
+                                     cachemap, chart)) {
                 result = true;
                 break;
             }
@@ -269,25 +723,26 @@ static bool matches_rule_list(const struct span span, dynarr *intarr,
 }
 
 static bool matches_rule_int(const struct span span, int rulenum,
-                             const struct rule *rules, hashmap *cachemap) {
+                             const struct ruletable *table, hashmap *cachemap,
+                             struct chart *chart) {
     if(span.end - span.start < 1) {
         printf("Illegal span! (%zu->%zu) Exiting\n", span.start, span.end);
         exit(1);
     }
 
-    struct rule rule = rules[rulenum];
+    const struct flatrule *rule = &table->rules[rulenum];
     size_t len = span.end - span.start;
 
-    if(rule.kind == BASIC) {
-        return (len == 1) && (span.base[span.start] == rule.basic.ch);
+    if(rule->kind == BASIC) {
+        return (len == 1) && (span.base[span.start] == rule->ch);
 
-    } else if(rule.kind == COMPOUND) {
-        dynarr *arrays = rule.compound.arrays;
-        dynarr *arrays_array = arrays->elems;
-        for(int option = 0; option < arrays->len; option++) {
-            dynarr *intarr = &arrays_array[option];
-            if((len >= intarr->len) &&
-               matches_rule_list(span, intarr, rules, cachemap)) {
+    } else if(rule->kind == COMPOUND) {
+        for(uint32_t option = table->option_start[rulenum];
+            option < table->option_start[rulenum + 1]; option++) {
+            const int *arr = &table->elems[table->elem_start[option]];
+            int n = table->elem_start[option + 1] - table->elem_start[option];
+            if((len >= n) &&
+               matches_rule_list(span, arr, n, table, cachemap, chart)) {
                 return true;
             }
         }
@@ -299,26 +754,112 @@ static bool matches_rule_int(const struct span span, int rulenum,
     }
 }
 
+static bool language_has(const struct language *lang, const char *str,
+                         size_t len) {
+    if(lang->len != 0 && lang->len != len) {
+        return false;
+    }
+
+    struct chunk chunk = {.str = str, .len = len};
+    return uvector_find(lang->chunks, &chunk) != NULL;
+}
+
+// checks that str starts with `count` consecutive strings from lang.
+// lang must have a fixed length.
+static bool matches_chunks(const char *str, size_t count,
+                           const struct language *lang) {
+    for(size_t i = 0; i < count; i++) {
+        if(!language_has(lang, str + i * lang->len, lang->len)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool matches_shape(const struct span span, const struct flatrule *rule,
+                          const struct ruletable *table) {
+    const char *str = span.base + span.start;
+    size_t len = span.end - span.start;
+    const struct language *a = table->rules[rule->shape_a].lang;
+
+    if(rule->shape == SHAPE_REPEAT) {
+        return len % a->len == 0 && matches_chunks(str, len / a->len, a);
+    } else {
+        const struct language *b = table->rules[rule->shape_b].lang;
+        size_t pair = a->len + b->len;
+        if(len % pair != 0) {
+            return false;
+        }
+
+        size_t n = len / pair;
+        return matches_chunks(str, n, a) &&
+               matches_chunks(str + n * a->len, n, b);
+    }
+}
+
 static bool matches_rule(const struct span span, int rulenum,
-                         const struct rule *rules, hashmap *cachemap) {
+                         const struct ruletable *table, hashmap *cachemap,
+                         struct chart *chart) {
+    const struct flatrule *rule = &table->rules[rulenum];
+    PROFILE_COUNT(rulenum, calls);
+    if(!charset_has(&rule->first, span.base[span.start]) ||
+       !charset_has(&rule->last, span.base[span.end - 1])) {
+        PROFILE_COUNT(rulenum, pruned);
+        return false;
+    }
+
+    // both of these are cheaper than going through the cache.
+    if(rule->lang != NULL) {
+        PROFILE_COUNT(rulenum, fast);
+        return language_has(rule->lang, span.base + span.start,
+                            span.end - span.start);
+    }
+    if(rule->shape != SHAPE_NONE) {
+        PROFILE_COUNT(rulenum, fast);
+        return matches_shape(span, rule, table);
+    }
+
+    // the chart only knows about the current message, but it's much cheaper
+    // than the cache, which hashes the span and is shared by all messages.
+    uint16_t *cell = chart_cell(chart, rulenum, span.start, span.end);
+    if(cell != NULL && *cell >> 1 == chart->epoch) {
+        PROFILE_COUNT(rulenum, hits);
+        return *cell & 1;
+    }
 
     cached_result res = {.rulenum = rulenum, .span = span};
     cached_result *get;
     bool result;
     if((get = hashmap_get(cachemap, &res)) != NULL) {
+        PROFILE_COUNT(rulenum, hits);
         result = get->result;
     } else {
-        result = matches_rule_int(span, rulenum, rules, cachemap);
+        PROFILE_MISS(rulenum, result = matches_rule_int(span, rulenum, table,
+                                                         cachemap, chart));
         res.result = result;
         hashmap_set(cachemap, &res);
+        PROFILE_MEMO_SIZE(hashmap_count(cachemap));
     }
 
+    if(cell != NULL) {
+        *cell = (uint16_t)(chart->epoch << 1) | result;
+    }
     return result;
 }
 
-static void parse(struct rule **rules, size_t *rules_len, char ***msgs,
-                  size_t *msgs_len) {
-    FILE *input = fopen("inputs/day19.txt", "r");
+static int message_compare(const void *a_void, const void *b_void) {
+    const struct message *a = a_void;
+    const struct message *b = b_void;
+    return (a->len > b->len) - (a->len < b->len);
+}
+
+static void parse(const char *path, struct rule **rules, size_t *rules_len,
+                  struct msgbatch *batch) {
+    FILE *input = fopen(path, "r");
+    if(input == NULL) {
+        perror("Error opening day19 input");
+        exit(1);
+    }
 
     *rules_len = lines_until_empty(input);
     *rules = calloc(*rules_len, sizeof(struct rule));
@@ -327,29 +868,69 @@ static void parse(struct rule **rules, size_t *rules_len, char ***msgs,
     size_t size = 0;
     ssize_t len = 0;
 
-    // this loop and the next one will terminate when they encounter
-    // an empty line.
+    // this loop will terminate when it encounters an empty line.
     while((len = getline(&line, &size, input)) > 1) {
         struct rule rule = parse_rule(line);
         (*rules)[rule.num] = rule;
     }
+    free(line);
 
-    *msgs_len = lines_until_empty(input);
-    *msgs = calloc(*msgs_len, sizeof(char *));
+    // the rest of the file is read into one buffer, and the messages point
+    // into it.
+    long start = ftell(input);
+    fseek(input, 0, SEEK_END);
+    size_t buf_len = ftell(input) - start;
+    fseek(input, start, SEEK_SET);
 
-    int i = 0;
-    while((len = getline(&line, &size, input)) > 1) {
-        // no -1 because len doesn't include the null terminator
-        char *copy = calloc(len, sizeof(char));
-        strncpy(copy, line, len); // this also copies the newline to the end
-        copy[len - 1] = '\0';     // replace the ending newline with a null char
+    batch->buf = malloc(buf_len + 1);
+    buf_len = fread(batch->buf, sizeof(char), buf_len, input);
+    batch->buf[buf_len] = '\0';
+    fclose(input);
 
-        (*msgs)[i] = copy;
-        i += 1;
+    size_t lines = 0;
+    for(size_t i = 0; i < buf_len; i++) {
+        if(batch->buf[i] == '\n') {
+            lines += 1;
+        }
     }
+    batch->msgs = calloc(lines + 1, sizeof(struct message));
+    batch->msgs_len = 0;
+
+    // maps each message's contents to its index in batch->msgs. the chunk is
+    // the first member, so chunk_hash and chunk_compare work on it as is.
+    struct indexed_chunk {
+        struct chunk chunk;
+        size_t index;
+    };
+    hashmap *unique = hashmap_new(sizeof(struct indexed_chunk), 0, 0, 0,
+                                  chunk_hash, chunk_compare, NULL);
+    char *msg = batch->buf;
+    while(*msg != '\0' && *msg != '\n') {
+        char *newline = strchr(msg, '\n');
+        size_t msg_len = newline != NULL ? newline - msg : strlen(msg);
+        msg[msg_len] = '\0';
+
+        struct indexed_chunk item = {.chunk = {.str = msg, .len = msg_len},
+                                     .index = batch->msgs_len};
+        struct indexed_chunk *found = hashmap_get(unique, &item);
+        if(found != NULL) {
+            batch->msgs[found->index].count += 1;
+        } else {
+            batch->msgs[batch->msgs_len] =
+                (struct message){.str = msg, .len = msg_len, .count = 1};
+            hashmap_set(unique, &item);
+            batch->msgs_len += 1;
+        }
 
-    free(line);
-    fclose(input);
+        if(newline == NULL) {
+            break;
+        }
+        msg = newline + 1;
+    }
+    hashmap_free(unique);
+
+    qsort(batch->msgs, batch->msgs_len, sizeof(struct message),
+          message_compare);
 }
 
 static struct rule parse_rule(const char *line) {
@@ -427,33 +1008,1172 @@ static void populate_rule_arr(dynarr *intarr, const char *line) {
     }
 }
 
-// Returns the number of lines from the current position in the file
-// until an empty line is encountered (exclusive).
-// This function also returns the file position to where it was
-// before it was called.
-static size_t lines_until_empty(FILE *file) {
-    long curr = ftell(file);
+// Computes the FIRST and LAST character sets of every rule. Since rules can be
+// recursive, the sets are grown until they stop changing.
+// Every rule matches at least one character, so only the first (or last)
+// element of each option can contribute to the set.
+// If dirty isn't NULL, only the rules marked in it are recomputed.
+static void analyze_rules(struct rule *rules, size_t rules_len,
+                          const bool *dirty) {
+    for(size_t i = 0; i < rules_len; i++) {
+        struct rule *rule = &rules[i];
+        if(dirty != NULL && !dirty[i]) {
+            continue;
+        }
 
-    bool last_was_newline = false;
-    size_t lines = 0;
+        memset(&rule->first, 0, sizeof(rule->first));
+        memset(&rule->last, 0, sizeof(rule->last));
 
-    int out = 0;
-    while((out = fgetc(file)) != EOF) {
-        char ch = out;
-        if(ch == '\n') {
-            if(last_was_newline) {
+        if(rule->kind == BASIC) {
+            charset_add(&rule->first, rule->basic.ch);
+            charset_add(&rule->last, rule->basic.ch);
+        }
+    }
+
+    bool changed = true;
+    while(changed) {
+        changed = false;
+        for(size_t i = 0; i < rules_len; i++) {
+            struct rule *rule = &rules[i];
+            if(rule->kind != COMPOUND) {
+                continue;
+            }
+
+            dynarr *arrays = rule->compound.arrays;
+            dynarr *intarrays = arrays->elems;
+            for(size_t j = 0; j < arrays->len; j++) {
+                int *elems = intarrays[j].elems;
+                size_t n = intarrays[j].len;
+
+                changed |= charset_union(&rule->first, &rules[elems[0]].first);
+                changed |=
+                    charset_union(&rule->last, &rules[elems[n - 1]].last);
+            }
+        }
+    }
+}
+
+static struct language *language_new(void) {
+    struct language *lang = malloc(sizeof(*lang));
+    lang->chunks =
+        uvector_init(sizeof(struct chunk), chunk_hash, chunk_compare);
+    lang->len = 0;
+    return lang;
+}
+
+static void free_language(struct language *lang) {
+    if(lang == NULL) {
+        return;
+    }
+
+    struct chunk *chunks = (struct chunk *)lang->chunks->vec.items;
+    for(size_t i = 0; i < lang->chunks->vec.length; i++) {
+        free((char *)chunks[i].str);
+    }
+    uvector_free(lang->chunks);
+    free(lang);
+}
+
+// adds the concatenation of a and b to lang, unless it's already there.
+static void language_add(struct language *lang, const struct chunk *a,
+                         const struct chunk *b) {
+    char *str = malloc(a->len + b->len);
+    memcpy(str, a->str, a->len);
+    memcpy(str + a->len, b->str, b->len);
+
+    struct chunk chunk = {.str = str, .len = a->len + b->len};
+    const struct chunk *stored = uvector_push_unique(lang->chunks, &chunk);
+    if(stored->str != str) { // it was already there
+        free(str);
+    }
+}
+
+// returns the language of a sequence of rules, or NULL if it's too large.
+static struct language *language_of_list(const int *arr, size_t n,
+                                         const struct rule *rules) {
+    struct language *lang = language_new();
+    struct chunk empty = {.str = "", .len = 0};
+    language_add(lang, &empty, &empty);
+
+    for(size_t i = 0; i < n; i++) {
+        const struct language *next = rules[arr[i]].lang;
+        if(lang->chunks->vec.length * next->chunks->vec.length >
+           LANGUAGE_LIMIT) {
+            free_language(lang);
+            return NULL;
+        }
+
+        struct language *product = language_new();
+        struct chunk *lefts = (struct chunk *)lang->chunks->vec.items;
+        struct chunk *rights = (struct chunk *)next->chunks->vec.items;
+        for(size_t l = 0; l < lang->chunks->vec.length; l++) {
+            for(size_t r = 0; r < next->chunks->vec.length; r++) {
+                language_add(product, &lefts[l], &rights[r]);
+            }
+        }
+
+        free_language(lang);
+        lang = product;
+    }
+
+    return lang;
+}
+
+enum langstate { LANG_UNVISITED, LANG_VISITING, LANG_DONE };
+
+// enumerates the language of a rule after enumerating the rules it refers to.
+// a rule that refers back to itself (directly or not) doesn't get a language.
+static void enumerate_rule(struct rule *rules, int rulenum,
+                           enum langstate *states) {
+    struct rule *rule = &rules[rulenum];
+    if(states[rulenum] != LANG_UNVISITED) {
+        return;
+    }
+    states[rulenum] = LANG_VISITING;
+
+    struct language *lang = NULL;
+    if(rule->kind == BASIC) {
+        lang = language_new();
+        struct chunk ch = {.str = &rule->basic.ch, .len = 1};
+        struct chunk empty = {.str = "", .len = 0};
+        language_add(lang, &ch, &empty);
+    } else if(rule->kind == COMPOUND) {
+        dynarr *arrays = rule->compound.arrays;
+        dynarr *intarrays = arrays->elems;
+
+        bool finite = true;
+        for(size_t i = 0; finite && i < arrays->len; i++) {
+            int *elems = intarrays[i].elems;
+            for(size_t j = 0; j < intarrays[i].len; j++) {
+                enumerate_rule(rules, elems[j], states);
+                if(states[elems[j]] == LANG_VISITING ||
+                   rules[elems[j]].lang == NULL) {
+                    finite = false;
+                    break;
+                }
+            }
+        }
+
+        for(size_t i = 0; finite && i < arrays->len; i++) {
+            struct language *option = language_of_list(
+                intarrays[i].elems, intarrays[i].len, rules);
+            if(option == NULL) {
+                finite = false;
                 break;
-            } else {
-                last_was_newline = true;
             }
-            lines += 1;
-        } else {
-            if(last_was_newline) {
-                last_was_newline = false;
+
+            if(lang == NULL) {
+                lang = option;
+                continue;
+            }
+            if(lang->chunks->vec.length + option->chunks->vec.length >
+               LANGUAGE_LIMIT) {
+                free_language(option);
+                finite = false;
+                break;
+            }
+
+            struct chunk *chunks = (struct chunk *)option->chunks->vec.items;
+            struct chunk empty = {.str = "", .len = 0};
+            for(size_t j = 0; j < option->chunks->vec.length; j++) {
+                language_add(lang, &chunks[j], &empty);
+            }
+            free_language(option);
+        }
+
+        if(!finite) {
+            free_language(lang);
+            lang = NULL;
+        }
+    }
+
+    if(lang != NULL) {
+        struct chunk *chunks = (struct chunk *)lang->chunks->vec.items;
+        lang->len = chunks[0].len;
+        for(size_t i = 1; i < lang->chunks->vec.length; i++) {
+            if(chunks[i].len != lang->len) {
+                lang->len = 0;
+                break;
             }
         }
     }
 
-    fseek(file, curr, SEEK_SET);
-    return lines;
+    rule->lang = lang;
+    states[rulenum] = LANG_DONE;
 }
+
+static bool has_fixed_language(const struct rule *rules, int rulenum) {
+    return rules[rulenum].lang != NULL && rules[rulenum].lang->len != 0;
+}
+
+// recognizes the `a | a x` and `a b | a x b` shapes, where a and b have
+// fixed-length languages.
+static void detect_shape(struct rule *rules, int rulenum) {
+    struct rule *rule = &rules[rulenum];
+    rule->shape = SHAPE_NONE;
+    if(rule->kind != COMPOUND || rule->lang != NULL ||
+       rule->compound.arrays->len != 2) {
+        return;
+    }
+
+    dynarr *intarrays = rule->compound.arrays->elems;
+    int *base = intarrays[0].elems;
+    int *rec = intarrays[1].elems;
+    size_t base_len = intarrays[0].len;
+    size_t rec_len = intarrays[1].len;
+
+    if(base_len == 1 && rec_len == 2 && rec[0] == base[0] &&
+       rec[1] == rulenum && has_fixed_language(rules, base[0])) {
+        rule->shape = SHAPE_REPEAT;
+        rule->shape_a = base[0];
+    } else if(base_len == 2 && rec_len == 3 && rec[0] == base[0] &&
+              rec[1] == rulenum && rec[2] == base[1] &&
+              has_fixed_language(rules, base[0]) &&
+              has_fixed_language(rules, base[1])) {
+        rule->shape = SHAPE_NEST;
+        rule->shape_a = base[0];
+        rule->shape_b = base[1];
+    }
+}
+
+// Enumerates the languages of all rules that are small enough, then finds
+// the recursive rules that can be matched with them.
+// If dirty isn't NULL, the languages of the other rules are kept as they are.
+static void build_languages(struct rule *rules, size_t rules_len,
+                            const bool *dirty) {
+    enum langstate *states = calloc(rules_len, sizeof(enum langstate));
+
+    for(size_t i = 0; i < rules_len; i++) {
+        if(dirty != NULL && !dirty[i]) {
+            states[i] = LANG_DONE;
+            continue;
+        }
+
+        free_language(rules[i].lang);
+        rules[i].lang = NULL;
+    }
+    for(size_t i = 0; i < rules_len; i++) {
+        enumerate_rule(rules, i, states);
+    }
+    for(size_t i = 0; i < rules_len; i++) {
+        if(dirty == NULL || dirty[i]) {
+            detect_shape(rules, i);
+        }
+    }
+
+    free(states);
+}
+
+static dynarr *options_of(const struct rule *rule) {
+    return rule->compound.arrays->elems;
+}
+
+static size_t options_len(const struct rule *rule) {
+    return rule->compound.arrays->len;
+}
+
+static bool is_pinned(int rulenum, const int *pinned, size_t pinned_len) {
+    for(size_t i = 0; i < pinned_len; i++) {
+        if(pinned[i] == rulenum) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static size_t count_live_rules(const struct rule *rules, size_t rules_len) {
+    size_t counter = 0;
+    for(size_t i = 0; i < rules_len; i++) {
+        if(rules[i].kind != UNUSED) {
+            counter += 1;
+        }
+    }
+    return counter;
+}
+
+// pushes a new option made of a[0..alen), b[0..blen) and c[0..clen) onto
+// options, which is a vector of dynarrs.
+static void push_option(vector_t *options, const int *a, size_t alen,
+                        const int *b, size_t blen, const int *c, size_t clen) {
+    dynarr option;
+    dynarr_init(&option, alen + blen + clen, sizeof(int));
+    int *elems = option.elems;
+
+    // b and c are allowed to be NULL when they're empty
+    memcpy(elems, a, alen * sizeof(int));
+    if(blen > 0) {
+        memcpy(elems + alen, b, blen * sizeof(int));
+    }
+    if(clen > 0) {
+        memcpy(elems + alen + blen, c, clen * sizeof(int));
+    }
+
+    vector_push(options, &option);
+}
+
+// makes a compound rule out of a vector of dynarrs, which is freed.
+static struct rule rule_from_options(int num, vector_t *options) {
+    struct rule rule = {.num = num, .kind = COMPOUND};
+    rule.compound.arrays = dynarr_new(options->length, sizeof(dynarr));
+    memcpy(rule.compound.arrays->elems, options->items,
+           options->length * sizeof(dynarr));
+
+    vector_free(options);
+    return rule;
+}
+
+static void remove_rule(struct rule *rule) {
+    free_rule(rule);
+    memset(rule, 0, sizeof(*rule));
+}
+
+static bool refers_to(const struct rule *rule, int rulenum) {
+    for(size_t i = 0; i < options_len(rule); i++) {
+        int *elems = options_of(rule)[i].elems;
+        for(size_t j = 0; j < options_of(rule)[i].len; j++) {
+            if(elems[j] == rulenum) {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+static void mark_reachable(const struct rule *rules, int rulenum,
+                           bool *reachable) {
+    if(reachable[rulenum]) {
+        return;
+    }
+    reachable[rulenum] = true;
+
+    const struct rule *rule = &rules[rulenum];
+    if(rule->kind != COMPOUND) {
+        return;
+    }
+    for(size_t i = 0; i < options_len(rule); i++) {
+        int *elems = options_of(rule)[i].elems;
+        for(size_t j = 0; j < options_of(rule)[i].len; j++) {
+            mark_reachable(rules, elems[j], reachable);
+        }
+    }
+}
+
+// removes every rule that can't be reached from the pinned rules.
+static void remove_unreachable(struct rule *rules, size_t rules_len,
+                               const int *pinned, size_t pinned_len) {
+    bool *reachable = calloc(rules_len, sizeof(bool));
+    for(size_t i = 0; i < pinned_len; i++) {
+        mark_reachable(rules, pinned[i], reachable);
+    }
+
+    for(size_t i = 0; i < rules_len; i++) {
+        if(!reachable[i] && rules[i].kind != UNUSED) {
+            remove_rule(&rules[i]);
+        }
+    }
+    free(reachable);
+}
+
+// replaces every reference to a rule of the form `x: y` with y.
+// returns true if anything was replaced.
+static bool eliminate_unit_rules(struct rule *rules, size_t rules_len,
+                                 const int *pinned, size_t pinned_len) {
+    int *target = calloc(rules_len, sizeof(int));
+    for(size_t i = 0; i < rules_len; i++) {
+        const struct rule *rule = &rules[i];
+        target[i] = i;
+        if(rule->kind == COMPOUND && options_len(rule) == 1 &&
+           options_of(rule)[0].len == 1 && !is_pinned(i, pinned, pinned_len)) {
+            target[i] = ((int *)options_of(rule)[0].elems)[0];
+        }
+    }
+
+    bool changed = false;
+    for(size_t i = 0; i < rules_len; i++) {
+        const struct rule *rule = &rules[i];
+        if(rule->kind != COMPOUND) {
+            continue;
+        }
+
+        for(size_t j = 0; j < options_len(rule); j++) {
+            int *elems = options_of(rule)[j].elems;
+            for(size_t k = 0; k < options_of(rule)[j].len; k++) {
+                // follow chains of unit rules, but give up on cycles.
+                int next = elems[k];
+                for(size_t steps = 0; steps < rules_len; steps++) {
+                    if(target[next] == next) {
+                        break;
+                    }
+                    next = target[next];
+                }
+
+                if(next != elems[k] && next != i) {
+                    elems[k] = next;
+                    changed = true;
+                }
+            }
+        }
+    }
+
+    free(target);
+    return changed;
+}
+
+// finds a non-pinned, non-recursive compound rule that is referred to exactly
+// once, and replaces its single use with its body: if the rule is a single
+// sequence it is spliced into the referring option, otherwise the referring
+// option is split into one option per alternative.
+// returns true if a rule was inlined.
+static bool inline_single_use_rule(struct rule *rules, size_t rules_len,
+                                   const int *pinned, size_t pinned_len) {
+    int *uses = calloc(rules_len, sizeof(int));
+    for(size_t i = 0; i < rules_len; i++) {
+        if(rules[i].kind != COMPOUND) {
+            continue;
+        }
+        for(size_t j = 0; j < options_len(&rules[i]); j++) {
+            int *elems = options_of(&rules[i])[j].elems;
+            for(size_t k = 0; k < options_of(&rules[i])[j].len; k++) {
+                uses[elems[k]] += 1;
+            }
+        }
+    }
+
+    for(size_t i = 0; i < rules_len; i++) {
+        struct rule *parent = &rules[i];
+        if(parent->kind != COMPOUND) {
+            continue;
+        }
+
+        for(size_t j = 0; j < options_len(parent); j++) {
+            int *elems = options_of(parent)[j].elems;
+            size_t len = options_of(parent)[j].len;
+            for(size_t k = 0; k < len; k++) {
+                int child_num = elems[k];
+                const struct rule *child = &rules[child_num];
+                if(uses[child_num] != 1 || child->kind != COMPOUND ||
+                   child_num == i || is_pinned(child_num, pinned, pinned_len) ||
+                   refers_to(child, child_num)) {
+                    continue;
+                }
+
+                vector_t *options = vector_init(sizeof(dynarr));
+                for(size_t o = 0; o < options_len(parent); o++) {
+                    dynarr *option = &options_of(parent)[o];
+                    if(o != j) {
+                        push_option(options, option->elems, option->len, NULL,
+                                    0, NULL, 0);
+                        continue;
+                    }
+
+                    for(size_t c = 0; c < options_len(child); c++) {
+                        dynarr *body = &options_of(child)[c];
+                        push_option(options, elems, k, body->elems, body->len,
+                                    elems + k + 1, len - k - 1);
+                    }
+                }
+
+                struct rule inlined = rule_from_options(parent->num, options);
+                free_rule(parent);
+                *parent = inlined;
+                remove_rule(&rules[child_num]);
+
+                free(uses);
+                return true;
+            }
+        }
+    }
+
+    free(uses);
+    return false;
+}
+
+// for every (non-recursive) rule, options that share a common prefix and
+// differ after it are merged into `prefix y`, where y is a new rule that
+// holds the different suffixes. recursive rules are left alone so that
+// detect_shape can still recognize them.
+static void merge_common_prefixes(struct rule **rules, size_t *rules_len) {
+    size_t original_len = *rules_len;
+    for(size_t i = 0; i < original_len; i++) {
+        struct rule *rule = &(*rules)[i];
+        if(rule->kind != COMPOUND || options_len(rule) < 2 ||
+           refers_to(rule, i)) {
+            continue;
+        }
+
+        size_t n = options_len(rule);
+        bool *grouped = calloc(n, sizeof(bool));
+        vector_t *options = vector_init(sizeof(dynarr));
+        vector_t *suffixes = NULL;
+        bool merged = false;
+
+        for(size_t j = 0; j < n; j++) {
+            if(grouped[j]) {
+                continue;
+            }
+
+            dynarr *first = &options_of(rule)[j];
+            int *first_elems = first->elems;
+
+            // every option in the group must have something left after the
+            // prefix, because rules can't match the empty string.
+            size_t prefix = first->len - 1;
+            size_t group_size = 1;
+            for(size_t k = j + 1; k < n; k++) {
+                dynarr *other = &options_of(rule)[k];
+                int *other_elems = other->elems;
+                if(grouped[k] || other->len < 2 ||
+                   other_elems[0] != first_elems[0] || first->len < 2) {
+                    continue;
+                }
+
+                size_t common = 0;
+                while(common < prefix && common < other->len - 1 &&
+                      other_elems[common] == first_elems[common]) {
+                    common += 1;
+                }
+                prefix = common;
+                group_size += 1;
+            }
+
+            if(group_size < 2) {
+                push_option(options, first->elems, first->len, NULL, 0, NULL,
+                            0);
+                continue;
+            }
+
+            // the new rule is appended, which may move the rules array.
+            int new_num = *rules_len;
+            *rules = realloc(*rules, (*rules_len + 1) * sizeof(struct rule));
+            *rules_len += 1;
+            rule = &(*rules)[i];
+
+            suffixes = vector_init(sizeof(dynarr));
+            for(size_t k = j; k < n; k++) {
+                dynarr *other = &options_of(rule)[k];
+                int *other_elems = other->elems;
+                if(grouped[k] || other->len < 2 ||
+                   other_elems[0] != first_elems[0]) {
+                    continue;
+                }
+
+                grouped[k] = true;
+                push_option(suffixes, other_elems + prefix, other->len - prefix,
+                            NULL, 0, NULL, 0);
+            }
+            (*rules)[new_num] = rule_from_options(new_num, suffixes);
+
+            push_option(options, first_elems, prefix, &new_num, 1, NULL, 0);
+            merged = true;
+        }
+
+        if(merged) {
+            struct rule replacement = rule_from_options(rule->num, options);
+            free_rule(rule);
+            *rule = replacement;
+        } else {
+            dynarr *unused = (dynarr *)options->items;
+            for(size_t j = 0; j < options->length; j++) {
+                free(unused[j].elems);
+            }
+            vector_free(options);
+        }
+        free(grouped);
+    }
+}
+
+// Simplifies the grammar without changing what the pinned rules match:
+// removes rules that can't be reached from them, inlines unit rules and
+// rules that are used once (which also flattens nested sequences), and
+// factors out common prefixes of options.
+static void optimize_rules(struct rule **rules, size_t *rules_len,
+                           const int *pinned, size_t pinned_len) {
+    size_t before = count_live_rules(*rules, *rules_len);
+
+    remove_unreachable(*rules, *rules_len, pinned, pinned_len);
+    bool changed = true;
+    while(changed) {
+        changed = eliminate_unit_rules(*rules, *rules_len, pinned, pinned_len);
+        remove_unreachable(*rules, *rules_len, pinned, pinned_len);
+        while(inline_single_use_rule(*rules, *rules_len, pinned, pinned_len)) {
+            changed = true;
+        }
+    }
+    merge_common_prefixes(rules, rules_len);
+
+    // a diagnostic, kept out of the answers on stdout.
+    fprintf(stderr, "Optimized grammar: %zu rules -> %zu rules\n", before,
+            count_live_rules(*rules, *rules_len));
+}
+
+// Flattens the rules into a ruletable. The languages are shared with the rules,
+// so the table can't be used once they are freed.
+static struct ruletable *build_ruletable(const struct rule *rules,
+                                         size_t rules_len) {
+    size_t options_total = 0, elems_total = 0;
+    for(size_t i = 0; i < rules_len; i++) {
+        if(rules[i].kind != COMPOUND) {
+            continue;
+        }
+        options_total += options_len(&rules[i]);
+        for(size_t j = 0; j < options_len(&rules[i]); j++) {
+            elems_total += options_of(&rules[i])[j].len;
+        }
+    }
+
+    // the arrays are ordered by decreasing alignment so that no padding is
+    // needed between them.
+    size_t size = sizeof(struct ruletable) +
+                  rules_len * sizeof(struct flatrule) +
+                  (rules_len + 1) * sizeof(uint32_t) +
+                  (options_total + 1) * sizeof(uint32_t) +
+                  elems_total * sizeof(int);
+    struct ruletable *table = calloc(1, size);
+    table->rules_len = rules_len;
+    table->rules = (struct flatrule *)(table + 1);
+    table->option_start = (uint32_t *)(table->rules + rules_len);
+    table->elem_start = table->option_start + rules_len + 1;
+    table->elems = (int *)(table->elem_start + options_total + 1);
+
+    uint32_t option = 0, elem = 0;
+    for(size_t i = 0; i < rules_len; i++) {
+        const struct rule *rule = &rules[i];
+        struct flatrule *flat = &table->rules[i];
+        flat->kind = rule->kind;
+        flat->ch = rule->kind == BASIC ? rule->basic.ch : '\0';
+        flat->shape = rule->shape;
+        flat->shape_a = rule->shape_a;
+        flat->shape_b = rule->shape_b;
+        flat->first = rule->first;
+        flat->last = rule->last;
+        flat->lang = rule->lang;
+
+        table->option_start[i] = option;
+        if(rule->kind != COMPOUND) {
+            continue;
+        }
+        for(size_t j = 0; j < options_len(rule); j++) {
+            const dynarr *intarr = &options_of(rule)[j];
+            table->elem_start[option] = elem;
+            memcpy(&table->elems[elem], intarr->elems,
+                   intarr->len * sizeof(int));
+            elem += intarr->len;
+            option += 1;
+        }
+    }
+    table->option_start[rules_len] = option;
+    table->elem_start[options_total] = elem;
+
+    return table;
+}
+
+#if defined(DAY19_GEN) || defined(DAY19_GENERATED)
+VECTOR_DEFINE(intvec, int)
+
+// Hashes the structure of the rules, to tell whether two rule sets are equal.
+static uint64_t rules_fingerprint(const struct rule *rules, size_t rules_len) {
+    struct intvec words = {0};
+    for(size_t i = 0; i < rules_len; i++) {
+        const struct rule *rule = &rules[i];
+        intvec_push(&words, rule->kind);
+        intvec_push(&words, rule->kind == BASIC ? rule->basic.ch : 0);
+
+        if(rule->kind != COMPOUND) {
+            continue;
+        }
+        for(size_t j = 0; j < options_len(rule); j++) {
+            const dynarr *option = &options_of(rule)[j];
+            intvec_push(&words, option->len);
+            intvec_append(&words, option->elems, option->len);
+        }
+    }
+
+    uint64_t hash =
+        hashmap_sip(words.items, words.length * sizeof(int), 0, 0);
+    intvec_free(&words);
+    return hash;
+}
+#endif
+
+// the rules that refer to a rule. Most rules are only used by a few others,
+// so eight of them fit without allocating.
+SMALLVEC_DEFINE(rulelist, int, 8)
+
+// Returns, for every rule, the rules that refer to it.
+static struct rulelist *build_dependents(const struct rule *rules,
+                                         size_t rules_len) {
+    struct rulelist *dependents = calloc(rules_len, sizeof(struct rulelist));
+
+    for(size_t i = 0; i < rules_len; i++) {
+        const struct rule *rule = &rules[i];
+        if(rule->kind != COMPOUND) {
+            continue;
+        }
+
+        int dependent = i;
+        dynarr *arrays = rule->compound.arrays;
+        dynarr *intarrays = arrays->elems;
+        for(size_t j = 0; j < arrays->len; j++) {
+            int *elems = intarrays[j].elems;
+            for(size_t k = 0; k < intarrays[j].len; k++) {
+                rulelist_push_unique(&dependents[elems[k]], dependent);
+            }
+        }
+    }
+
+    return dependents;
+}
+
+static void free_dependents(struct rulelist *dependents, size_t rules_len) {
+    for(size_t i = 0; i < rules_len; i++) {
+        rulelist_free(&dependents[i]);
+    }
+    free(dependents);
+}
+
+// marks rulenum and every rule that (transitively) refers to it.
+static void mark_dirty(struct rulelist *dependents, int rulenum,
+                       bool *dirty) {
+    if(dirty[rulenum]) {
+        return;
+    }
+    dirty[rulenum] = true;
+
+    int *users = rulelist_items(&dependents[rulenum]);
+    for(size_t i = 0; i < dependents[rulenum].length; i++) {
+        mark_dirty(dependents, users[i], dirty);
+    }
+}
+
+struct eviction {
+    const bool *dirty;
+    vector_t *evicted; // cached_result
+};
+
+static bool collect_dirty_results(const void *item, void *udata) {
+    const cached_result *res = item;
+    struct eviction *eviction = udata;
+
+    if(eviction->dirty[res->rulenum]) {
+        vector_push(eviction->evicted, res);
+    }
+    return true;
+}
+
+// Replaces the rules given in `lines` (which are in the same format as the
+// input), and recomputes everything that depends on them. Cached results
+// are only dropped for the replaced rules and the rules that refer to them,
+// so the rest of the cache stays usable.
+static void update_rules(struct rule *rules, size_t rules_len,
+                         const char *const *lines, size_t lines_len,
+                         hashmap *cachemap) {
+    // the rules that refer to a rule don't change when it's replaced, so the
+    // graph from before the update is enough to find everything affected.
+    struct rulelist *dependents = build_dependents(rules, rules_len);
+    bool *dirty = calloc(rules_len, sizeof(bool));
+
+    for(size_t i = 0; i < lines_len; i++) {
+        struct rule rule = parse_rule(lines[i]);
+        if(rule.num < 0 || rule.num >= rules_len) {
+            printf("Updated rule %d doesn't exist! Exiting.\n", rule.num);
+            exit(1);
+        }
+
+        free_rule(&rules[rule.num]);
+        rules[rule.num] = rule;
+        mark_dirty(dependents, rule.num, dirty);
+    }
+
+    analyze_rules(rules, rules_len, dirty);
+    build_languages(rules, rules_len, dirty);
+
+    struct eviction eviction = {.dirty = dirty,
+                                .evicted = vector_init(sizeof(cached_result))};
+    hashmap_scan(cachemap, collect_dirty_results, &eviction);
+
+    cached_result *evicted = (cached_result *)eviction.evicted->items;
+    for(size_t i = 0; i < eviction.evicted->length; i++) {
+        hashmap_delete(cachemap, &evicted[i]);
+    }
+
+    vector_free(eviction.evicted);
+    free(dirty);
+    free_dependents(dependents, rules_len);
+}
+
+// Returns the number of lines from the current position in the file
+// until an empty line is encountered (exclusive).
+// This function also returns the file position to where it was
+// before it was called.
+static size_t lines_until_empty(FILE *file) {
+    long curr = ftell(file);
+
+    bool last_was_newline = false;
+    size_t lines = 0;
+
+    int out = 0;
+    while((out = fgetc(file)) != EOF) {
+        char ch = out;
+        if(ch == '\n') {
+            if(last_was_newline) {
+                break;
+            } else {
+                last_was_newline = true;
+            }
+            lines += 1;
+        } else {
+            if(last_was_newline) {
+                last_was_newline = false;
+            }
+        }
+    }
+
+    fseek(file, curr, SEEK_SET);
+    return lines;
+}
+
+//==============================================================================
+// MATCHER GENERATOR
+// Emits C source with one matching function per rule, for both parts, so that
+// a fixed grammar can be matched without interpreting the rule table. The
+// output is meant to be saved as day19_matchers.h and compiled in with
+// -DDAY19_GENERATED, which is what bldgen.sh does.
+// $ cc -DDAY19_GEN day19.c <libs> && ./a.out inputs/day19.txt day19_matchers.h
+//==============================================================================
+#ifdef DAY19_GEN
+
+#define UNBOUNDED SIZE_MAX
+
+// the shortest and longest strings each rule can match.
+struct lengths {
+    size_t *min;
+    size_t *max;
+};
+
+static size_t add_lengths(size_t a, size_t b) {
+    return (a == UNBOUNDED || b == UNBOUNDED) ? UNBOUNDED : a + b;
+}
+
+static size_t option_length(const size_t *lens, const dynarr *option) {
+    const int *elems = option->elems;
+    size_t sum = 0;
+    for(size_t i = 0; i < option->len; i++) {
+        sum = add_lengths(sum, lens[elems[i]]);
+    }
+    return sum;
+}
+
+enum maxstate { MAX_UNVISITED, MAX_VISITING, MAX_DONE };
+
+// a rule that can reach itself matches arbitrarily long strings.
+static void compute_max(const struct rule *rules, int rulenum, size_t *max,
+                        enum maxstate *states) {
+    if(states[rulenum] == MAX_DONE) {
+        return;
+    }
+    if(states[rulenum] == MAX_VISITING) {
+        max[rulenum] = UNBOUNDED;
+        return;
+    }
+    states[rulenum] = MAX_VISITING;
+
+    const struct rule *rule = &rules[rulenum];
+    if(rule->kind == BASIC) {
+        max[rulenum] = 1;
+    } else if(rule->kind == COMPOUND) {
+        size_t longest = 0;
+        for(size_t i = 0; i < options_len(rule); i++) {
+            const dynarr *option = &options_of(rule)[i];
+            const int *elems = option->elems;
+            for(size_t j = 0; j < option->len; j++) {
+                compute_max(rules, elems[j], max, states);
+            }
+
+            size_t len = option_length(max, option);
+            if(len > longest) {
+                longest = len;
+            }
+        }
+        // a cycle below may have already marked this rule as unbounded.
+        if(max[rulenum] != UNBOUNDED) {
+            max[rulenum] = longest;
+        }
+    }
+    states[rulenum] = MAX_DONE;
+}
+
+static struct lengths compute_lengths(const struct rule *rules,
+                                      size_t rules_len) {
+    struct lengths lens = {.min = malloc(rules_len * sizeof(size_t)),
+                           .max = calloc(rules_len, sizeof(size_t))};
+
+    // the minimums can only shrink, so they are iterated from above.
+    for(size_t i = 0; i < rules_len; i++) {
+        lens.min[i] = rules[i].kind == BASIC ? 1 : UNBOUNDED;
+    }
+    bool changed = true;
+    while(changed) {
+        changed = false;
+        for(size_t i = 0; i < rules_len; i++) {
+            if(rules[i].kind != COMPOUND) {
+                continue;
+            }
+            for(size_t j = 0; j < options_len(&rules[i]); j++) {
+                size_t len = option_length(lens.min, &options_of(&rules[i])[j]);
+                if(len < lens.min[i]) {
+                    lens.min[i] = len;
+                    changed = true;
+                }
+            }
+        }
+    }
+
+    enum maxstate *states = calloc(rules_len, sizeof(enum maxstate));
+    for(size_t i = 0; i < rules_len; i++) {
+        compute_max(rules, i, lens.max, states);
+    }
+    free(states);
+
+    return lens;
+}
+
+static bool is_fixed(const struct lengths *lens, int rulenum) {
+    return lens->min[rulenum] == lens->max[rulenum];
+}
+
+static void emit_indent(FILE *out, int depth) {
+    fprintf(out, "%*s", depth * 4, "");
+}
+
+// emits an expression that checks rule `rulenum` against [from, to).
+// characters are compared inline instead of calling a function.
+static void emit_check(FILE *out, const char *prefix, const struct rule *rules,
+                       int rulenum, const char *from, const char *to) {
+    const struct rule *rule = &rules[rulenum];
+    if(rule->kind == BASIC) {
+        unsigned char ch = rule->basic.ch;
+        if(isprint(ch) && ch != '\'' && ch != '\\') {
+            fprintf(out, "s[%s] == '%c'", from, ch);
+        } else {
+            fprintf(out, "s[%s] == (char)%d", from, ch);
+        }
+    } else {
+        fprintf(out, "%s_r%d(s, %s, %s)", prefix, rulenum, from, to);
+    }
+}
+
+// emits the code that returns true if one option of a rule matches.
+// the fixed-length elements at either end of the option are checked at
+// constant offsets from the ends of the span, and the split points between
+// the remaining elements are found with (nested) loops.
+static void emit_option(FILE *out, const char *prefix, const struct rule *rules,
+                        const struct lengths *lens, const dynarr *option) {
+    const int *elems = option->elems;
+    size_t n = option->len;
+
+    size_t front = 0, front_len = 0;
+    while(front < n && is_fixed(lens, elems[front])) {
+        front_len += lens->min[elems[front]];
+        front += 1;
+    }
+    size_t back = n, back_len = 0;
+    while(back > front && is_fixed(lens, elems[back - 1])) {
+        back_len += lens->min[elems[back - 1]];
+        back -= 1;
+    }
+
+    fprintf(out, "    //");
+    for(size_t i = 0; i < n; i++) {
+        fprintf(out, " %d", elems[i]);
+    }
+    fprintf(out, "\n");
+
+    if(front == n) {
+        fprintf(out, "    if(len == %zu", front_len);
+    } else {
+        fprintf(out, "    if(len >= %zu", option_length(lens->min, option));
+    }
+
+    char from[64], to[64];
+    size_t offset = 0;
+    for(size_t i = 0; i < front; i++) {
+        snprintf(from, sizeof(from), "start + %zu", offset);
+        offset += lens->min[elems[i]];
+        snprintf(to, sizeof(to), "start + %zu", offset);
+        fprintf(out, " &&\n       ");
+        emit_check(out, prefix, rules, elems[i], from, to);
+    }
+    offset = 0;
+    for(size_t i = n; i > back; i--) {
+        snprintf(to, sizeof(to), "end - %zu", offset);
+        offset += lens->min[elems[i - 1]];
+        snprintf(from, sizeof(from), "end - %zu", offset);
+        fprintf(out, " &&\n       ");
+        emit_check(out, prefix, rules, elems[i - 1], from, to);
+    }
+    fprintf(out, ") {\n");
+
+    int depth = 2;
+    if(front == n) {
+        // everything has been checked already.
+        fprintf(out, "        return true;\n");
+    } else if(back - front == 1) {
+        snprintf(from, sizeof(from), "start + %zu", front_len);
+        snprintf(to, sizeof(to), "end - %zu", back_len);
+        emit_indent(out, depth);
+        fprintf(out, "if(");
+        emit_check(out, prefix, rules, elems[front], from, to);
+        fprintf(out, ") {\n");
+        emit_indent(out, depth + 1);
+        fprintf(out, "return true;\n");
+        emit_indent(out, depth);
+        fprintf(out, "}\n");
+    } else {
+        emit_indent(out, depth);
+        fprintf(out, "size_t p%zu = start + %zu;\n", front, front_len);
+
+        for(size_t i = front; i < back - 1; i++) {
+            size_t min_rest = back_len;
+            for(size_t j = i + 1; j < back; j++) {
+                min_rest += lens->min[elems[j]];
+            }
+
+            snprintf(from, sizeof(from), "p%zu", i);
+            snprintf(to, sizeof(to), "p%zu", i + 1);
+            emit_indent(out, depth);
+            if(is_fixed(lens, elems[i])) {
+                fprintf(out, "size_t p%zu = p%zu + %zu;\n", i + 1, i,
+                        lens->min[elems[i]]);
+            } else {
+                fprintf(out,
+                        "for(size_t p%zu = p%zu + %zu; p%zu + %zu <= end; "
+                        "p%zu++) {\n",
+                        i + 1, i, lens->min[elems[i]], i + 1, min_rest, i + 1);
+                depth += 1;
+                emit_indent(out, depth);
+            }
+
+            // the first element of the middle is never fixed, so this is
+            // always inside a loop.
+            fprintf(out, "if(!(");
+            emit_check(out, prefix, rules, elems[i], from, to);
+            fprintf(out, ")) {\n");
+            emit_indent(out, depth + 1);
+            fprintf(out, "continue;\n");
+            emit_indent(out, depth);
+            fprintf(out, "}\n");
+        }
+
+        snprintf(from, sizeof(from), "p%zu", back - 1);
+        snprintf(to, sizeof(to), "end - %zu", back_len);
+        emit_indent(out, depth);
+        fprintf(out, "if(");
+        emit_check(out, prefix, rules, elems[back - 1], from, to);
+        fprintf(out, ") {\n");
+        emit_indent(out, depth + 1);
+        fprintf(out, "return true;\n");
+        emit_indent(out, depth);
+        fprintf(out, "}\n");
+
+        while(depth > 2) {
+            depth -= 1;
+            emit_indent(out, depth);
+            fprintf(out, "}\n");
+        }
+    }
+
+    fprintf(out, "    }\n");
+}
+
+// emits one function per rule reachable from rule 0, and an entry point
+// called `entry` that matches a whole message against rule 0.
+static void emit_grammar(FILE *out, const char *prefix, const char *entry,
+                         const struct rule *rules, size_t rules_len) {
+    struct lengths lens = compute_lengths(rules, rules_len);
+    bool *reachable = calloc(rules_len, sizeof(bool));
+    mark_reachable(rules, 0, reachable);
+
+    for(size_t i = 0; i < rules_len; i++) {
+        if(reachable[i] && rules[i].kind == COMPOUND) {
+            fprintf(out,
+                    "static bool %s_r%zu(const char *s, size_t start, "
+                    "size_t end);\n",
+                    prefix, i);
+        }
+    }
+    fprintf(out, "\n");
+
+    for(size_t i = 0; i < rules_len; i++) {
+        const struct rule *rule = &rules[i];
+        if(!reachable[i] || rule->kind != COMPOUND) {
+            continue;
+        }
+
+        fprintf(out,
+                "static bool %s_r%zu(const char *s, size_t start, "
+                "size_t end) {\n",
+                prefix, i);
+        fprintf(out, "    size_t len = end - start;\n");
+        for(size_t j = 0; j < options_len(rule); j++) {
+            emit_option(out, prefix, rules, &lens, &options_of(rule)[j]);
+        }
+        fprintf(out, "    return false;\n}\n\n");
+    }
+
+    fprintf(out, "static bool %s(const char *s, size_t len) {\n", entry);
+    fprintf(out, "    return ");
+    emit_check(out, prefix, rules, 0, "0", "len");
+    if(rules[0].kind == BASIC) {
+        fprintf(out, " && len == 1");
+    }
+    fprintf(out, ";\n}\n\n");
+
+    free(reachable);
+    free(lens.min);
+    free(lens.max);
+}
+
+int main(int argc, char **argv) {
+    if(argc < 3) {
+        fprintf(stderr, "usage: %s <rules file> <output file>\n", argv[0]);
+        return 1;
+    }
+
+    struct rule *rules = NULL;
+    size_t rules_len = 0;
+    struct msgbatch batch;
+    parse(argv[1], &rules, &rules_len, &batch);
+    uint64_t fingerprint = rules_fingerprint(rules, rules_len);
+    optimize_rules(&rules, &rules_len, pinned_rules, 5);
+
+    FILE *out = fopen(argv[2], "w");
+    if(out == NULL) {
+        perror("Error opening output file");
+        return 1;
+    }
+    fprintf(out, "// generated from %s by day19.c (DAY19_GEN), do not edit.\n",
+            argv[1]);
+    fprintf(out, "#ifndef DAY19_MATCHERS_H\n#define DAY19_MATCHERS_H\n\n");
+    fprintf(out, "#include <stdbool.h>\n#include <stddef.h>\n\n");
+    fprintf(out, "#define DAY19_GEN_FINGERPRINT 0x%016llxULL\n\n",
+            (unsigned long long)fingerprint);
+    emit_grammar(out, "p1", "day19_gen_part1", rules, rules_len);
+
+    hashmap *cachemap = hashmap_new(sizeof(cached_result), 0, 0, 0, cached_hash,
+                                    cached_compare, NULL);
+    update_rules(rules, rules_len, part2_rules, 2, cachemap);
+    emit_grammar(out, "p2", "day19_gen_part2", rules, rules_len);
+    fprintf(out, "#endif // DAY19_MATCHERS_H\n");
+    fclose(out);
+
+    hashmap_free(cachemap);
+    free(batch.buf);
+    free(batch.msgs);
+    for(size_t i = 0; i < rules_len; i++) {
+        free_rule(&rules[i]);
+    }
+    free(rules);
+    return 0;
+}
+
+#endif // DAY19_GEN
@@ -1,29 +1,83 @@
 #include "aoc20.h"
 #include "assert.h"
-#include "hashmap.h"
 #include "vector.h"
 
+#include <fcntl.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
-#define TILE_SIDE 10
 #define NUM_EDGES 4
+#define NUM_ORIENTATIONS 8
+#define MAX_TILE_SIDE 64
+// up to this side, the edge index is a table with a slot for every edge code.
+#define DIRECT_INDEX_SIDE 16
+#define MAX_PATTERN_SIDE 64
+#define MAX_WORKERS 16
+// parts smaller than these aren't worth a thread of their own.
+#define MIN_BYTES_PER_WORKER (1 << 20)
+#define MIN_TILES_PER_WORKER 4096
+#define RADIX_BITS 8
+#define MAX_PATTERNS 16
+
+// An edge is encoded as an integer, with the edge's first pixel in the most
+// significant bit. An edge and its reverse are the same edge seen from the two
+// tiles that share it, so the index is keyed by the smaller of the two codes.
+typedef uint64_t edgecode_t;
 
-typedef struct hashmap hashmap_t;
-typedef struct vector vector_t;
+// A row of pixels, packed the same way as the edges: the leftmost pixel is the
+// most significant bit, so the top row is also the top edge's code.
+typedef uint64_t tilerow_t;
 
+// The edges are computed when the tile is parsed, so orienting a tile never
+// has to look at its pixels (see oriented_edge). The pixels are in the
+// puzzle's rows, at the tile's index.
 typedef struct tile {
     int id;
-    bool info[TILE_SIDE][TILE_SIDE];
+    // the clockwise edges (top, right, bottom, left), then their reverses.
+    edgecode_t codes[2 * NUM_EDGES];
 } tile_t;
 
-typedef struct edge {
-    bool edge[TILE_SIDE];
-    vector_t *tiles;
-} edge_t;
+VECTOR_DEFINE(tilevec, const tile_t *)
+
+// All the tiles share one array of rows, `side` rows per tile. Each row takes
+// row_bytes(side) bytes, the narrowest of 1, 2, 4 and 8 that fits it, so a
+// 10x10 tile's pixels take 20 bytes.
+typedef struct puzzle {
+    tile_t *tiles;
+    size_t len;
+    int side;
+    uint8_t *rows;
+} puzzle_t;
 
+// Which tiles have each canonical edge code, laid out in one array: the tiles
+// in slot i are tile_ids[offsets[i]] to tile_ids[offsets[i + 1] - 1]. Small
+// tiles have a slot for every possible code. For larger ones, the slots are
+// the distinct codes, kept sorted in `codes` for a binary search.
+typedef struct edge_index {
+    int side;
+    size_t slots;
+    uint32_t *offsets;
+    uint32_t *tile_ids;
+    edgecode_t *codes; // NULL for a direct table
+    size_t unique;
+} edge_index_t;
+
+// A tile is oriented by first flipping it horizontally (if flipped), then
+// rotating it clockwise. Orientations are numbered rotation + 4 * flipped.
 typedef struct tilematrix {
     struct {
         tile_t *source;
@@ -33,89 +87,207 @@ typedef struct tilematrix {
     size_t side;
 } tilematrix_t;
 
-static void parse(tile_t **tiles, size_t *tiles_len, hashmap_t *edges_map);
-static void parse_tile(FILE *input, tile_t *tile);
-static void get_edges(const tile_t *tile, edge_t edges[]);
-static edge_t flip_edge(edge_t edge);
-static edge_t *get_with_flip(hashmap_t *edges_map, edge_t *edge);
-static int count_tiles(FILE *file);
-static bool edge_vector_freer(const void *edge, void *udata);
-static long find_edge_tiles(hashmap_t *edges_map, const tile_t *tiles,
-                            size_t tiles_len, vector_t **edge_tiles);
+// The assembled picture, without the tiles' borders.
+typedef struct image {
+    size_t side;
+    bool *pixels;
+} image_t;
+
+// The image with every row stored as a bitset (bit i of word w is column
+// 64 * w + i), padded with zero words so shifted reads never leave the row.
+typedef struct bitimage {
+    size_t side;
+    size_t words; // per row
+    uint64_t *bits;
+} bitimage_t;
+
+// A search pattern in one orientation, one bitmask per row.
+typedef struct pattern {
+    int width, height;
+    uint64_t rows[MAX_PATTERN_SIDE];
+} pattern_t;
+
+// Every distinct orientation of each pattern that's searched for.
+typedef struct patternset {
+    pattern_t oriented[MAX_PATTERNS][NUM_ORIENTATIONS];
+    int orientations[MAX_PATTERNS];
+    size_t len;
+} patternset_t;
+
+static const char *sea_monster[] = {"                  # ",
+                                    "#    ##    ##    ###",
+                                    " #  #  #  #  #  #   ", NULL};
+
+typedef const char *(*tile_reader_t)(const char *cursor,
+                                     const char *input_end, tile_t *tile,
+                                     uint8_t *rows, int side);
+
+// A task is split into parts, which run on their own threads. Part 0 runs on
+// the calling thread.
+typedef void (*task_t)(void *context, int part, int parts);
 
-static int edge_compare(const void *a_void, const void *b_void, void *udata) {
-    const edge_t *a = a_void;
-    const edge_t *b = b_void;
-    return memcmp(&a->edge, &b->edge, sizeof(a->edge));
+static void parse(puzzle_t *puzzle);
+static tile_reader_t select_tile_reader(int side);
+static inline int row_bytes(int side);
+static void get_edges(const tilerow_t rows[], int side, edgecode_t codes[]);
+static uint64_t reverse_bits(uint64_t bits);
+static edgecode_t reverse_code(edgecode_t code, int side);
+static void orient_rows(const tilerow_t rows[], int side, int orientation,
+                        tilerow_t oriented[]);
+static void build_edge_index(const puzzle_t *puzzle, edge_index_t *index);
+static const uint32_t *get_edge_tiles(const edge_index_t *index,
+                                      edgecode_t code, size_t *count);
+static int count_workers(size_t size, size_t min_part_size);
+static void run_parallel(task_t task, void *context, int parts);
+static void free_edge_index(edge_index_t *index);
+static long find_edge_tiles(const edge_index_t *index, const puzzle_t *puzzle,
+                            struct tilevec *edge_tiles);
+static void init_tilematrix(tilematrix_t *matrix, size_t tiles_len);
+static bool assemble(const edge_index_t *index, const puzzle_t *puzzle,
+                     tilematrix_t *matrix);
+static bool search_assembly(const edge_index_t *index, const puzzle_t *puzzle,
+                            tilematrix_t *matrix);
+static image_t stitch_image(const puzzle_t *puzzle,
+                            const tilematrix_t *matrix);
+static void add_pattern(patternset_t *set, const char *rows[]);
+static void load_patterns(patternset_t *set, const char *path);
+static bitimage_t to_bitimage(const image_t *image);
+static size_t search_patterns(const bitimage_t *image, const patternset_t *set);
+
+// Returns the milliseconds since *since, and resets it to now.
+static double lap_ms(struct timespec *since) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    double ms = (now.tv_sec - since->tv_sec) * 1e3 +
+                (now.tv_nsec - since->tv_nsec) / 1e6;
+    *since = now;
+    return ms;
 }
 
-static uint64_t edge_hash(const void *item_void, uint64_t seed0,
-                          uint64_t seed1) {
-    const edge_t *item = item_void;
-    return hashmap_sip(&item->edge, sizeof(item->edge), seed0, seed1);
+static edgecode_t canonical_code(edgecode_t code, int side) {
+    edgecode_t reversed = reverse_code(code, side);
+    return reversed < code ? reversed : code;
 }
 
-static bool print_edge_details(const void *edge_void, void *udata) {
-    const edge_t *edge = edge_void;
-    int *counter = udata;
+static size_t edge_tile_count(const edge_index_t *index, edgecode_t code) {
+    size_t count;
+    get_edge_tiles(index, code, &count);
+    return count;
+}
 
-    printf("Edge #%.3d corresponds to %zu tiles.\n", *counter,
-           edge->tiles->length);
-    *counter += 1;
-    return true;
+// The edge in the given direction (0-3, clockwise from the top) of the tile
+// in the given orientation. A flip reverses every edge and swaps the left and
+// right ones, and a rotation moves every edge one step clockwise.
+static edgecode_t oriented_edge(const tile_t *tile, int orientation,
+                                int direction) {
+    int edge = (direction - orientation % 4 + NUM_EDGES) % NUM_EDGES;
+    if(orientation >= 4) {
+        edge = NUM_EDGES + (NUM_EDGES - edge) % NUM_EDGES;
+    }
+    return tile->codes[edge];
+}
+
+static void print_edge_details(const edge_index_t *index) {
+    int counter = 1;
+    for(size_t slot = 0; slot < index->slots; slot++) {
+        uint32_t count = index->offsets[slot + 1] - index->offsets[slot];
+        if(count == 0) {
+            continue;
+        }
+
+        printf("Edge #%.3d corresponds to %u tiles.\n", counter, count);
+        counter++;
+    }
 }
 
 void day20() {
     puts("Day 20 - Part 1");
 
-    hashmap_t *edges_map =
-        hashmap_new(sizeof(edge_t), 0, 0, 0, edge_hash, edge_compare, NULL);
-    assert(NULL != edges_map);
+    puzzle_t puzzle;
+    edge_index_t index;
 
-    tile_t *tiles;
-    size_t tiles_len;
+    struct timespec timer;
+    clock_gettime(CLOCK_MONOTONIC, &timer);
 
-    parse(&tiles, &tiles_len, edges_map);
-    printf("Parsing complete; %zu tiles, %zu unique edges.\n", tiles_len,
-           hashmap_count(edges_map));
+    parse(&puzzle);
+    double parse_ms = lap_ms(&timer);
+    build_edge_index(&puzzle, &index);
+    double index_ms = lap_ms(&timer);
+    printf("Parsing complete; %zu tiles of %dx%d, %zu unique edges.\n",
+           puzzle.len, puzzle.side, puzzle.side, index.unique);
 
-    vector_t *edge_tiles;
-    long mult = find_edge_tiles(edges_map, tiles, tiles_len, &edge_tiles);
+    struct tilevec edge_tiles = {0};
+    long mult = find_edge_tiles(&index, &puzzle, &edge_tiles);
 
     printf("Corner tile multiplication: %ld\n", mult);
 
-    int counter = 1;
-    hashmap_scan(edges_map, print_edge_details, &counter);
+    print_edge_details(&index);
+
+    lap_ms(&timer);
+    tilematrix_t matrix;
+    init_tilematrix(&matrix, puzzle.len);
+    if(!assemble(&index, &puzzle, &matrix)) {
+        puts("The edges don't match up uniquely; searching for an assembly.");
+        if(!search_assembly(&index, &puzzle, &matrix)) {
+            printf("The tiles can't be assembled! Exiting.\n");
+            exit(1);
+        }
+    }
+    image_t image = stitch_image(&puzzle, &matrix);
+    double assemble_ms = lap_ms(&timer);
+
+    printf("Assembled a %zux%zu image.\n", image.side, image.side);
+    printf("Timing: parse %.3f ms, index %.3f ms, assemble %.3f ms\n",
+           parse_ms, index_ms, assemble_ms);
+
+    puts("Day 20 - Part 2");
+
+    // more patterns can be given in a file, separated by empty lines.
+    patternset_t *patterns = calloc(1, sizeof(patternset_t));
+    assert(NULL != patterns);
+    add_pattern(patterns, sea_monster);
+    const char *patterns_path = getenv("DAY20_PATTERNS");
+    if(NULL != patterns_path) {
+        load_patterns(patterns, patterns_path);
+    }
+
+    lap_ms(&timer);
+    bitimage_t bitimage = to_bitimage(&image);
+    size_t roughness = search_patterns(&bitimage, patterns);
+    double search_ms = lap_ms(&timer);
 
-    vector_free(edge_tiles);
-    free(tiles);
-    hashmap_scan(edges_map, edge_vector_freer, NULL);
-    hashmap_free(edges_map);
+    printf("Water roughness: %zu\n", roughness);
+    printf("Timing: search %.3f ms\n", search_ms);
+
+    free(bitimage.bits);
+    free(patterns);
+    free(image.pixels);
+    free(matrix.tiles);
+    tilevec_free(&edge_tiles);
+    free(puzzle.tiles);
+    free(puzzle.rows);
+    free_edge_index(&index);
 }
 
-static long find_edge_tiles(hashmap_t *edges_map, const tile_t *tiles,
-                            size_t tiles_len, vector_t **edge_tiles) {
+static long find_edge_tiles(const edge_index_t *index, const puzzle_t *puzzle,
+                            struct tilevec *edge_tiles) {
     long mult = 1;
-    *edge_tiles = vector_init(sizeof(tile_t *));
-    for(size_t i = 0; i < tiles_len; i++) {
-        const tile_t *tile = &tiles[i];
-
-        edge_t edges[NUM_EDGES];
-        get_edges(tile, edges);
+    for(size_t i = 0; i < puzzle->len; i++) {
+        const tile_t *tile = &puzzle->tiles[i];
 
         int nonmatching = 0;
         for(int j = 0; j < NUM_EDGES; j++) {
-            edge_t *found = get_with_flip(edges_map, &edges[j]);
-            assert(NULL != found);
+            size_t found = edge_tile_count(index, tile->codes[j]);
+            assert(found > 0);
 
-            if(found->tiles->length == 1)
+            if(found == 1)
             { // this tile is the only tile that has this edge
                 nonmatching++;
             }
         }
 
         if(nonmatching > 0) {
-            vector_push(*edge_tiles, &tile);
+            tilevec_push(edge_tiles, tile);
         }
 
         if(nonmatching == 2) {
@@ -126,104 +298,1641 @@ static long find_edge_tiles(hashmap_t *edges_map, const tile_t *tiles,
     return mult;
 }
 
-static void parse(tile_t **tiles, size_t *tiles_len, hashmap_t *edges_map) {
-    FILE *input = fopen("inputs/day20.txt", "r");
+// Maps the whole file into memory, so that it's read exactly once.
+static const char *map_file(const char *path, size_t *len) {
+    int fd = open(path, O_RDONLY);
+    struct stat info;
+    if(fd == -1 || fstat(fd, &info) == -1 || info.st_size == 0) {
+        printf("Couldn't open %s! Exiting.\n", path);
+        exit(1);
+    }
 
-    *tiles_len = count_tiles(input);
-    *tiles = calloc(*tiles_len, sizeof(tile_t));
+    void *contents = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if(contents == MAP_FAILED) {
+        printf("Couldn't map %s! Exiting.\n", path);
+        exit(1);
+    }
 
-    for(int i = 0; i < *tiles_len; i++) {
-        tile_t *tile = &(*tiles)[i];
-        parse_tile(input, tile);
+    close(fd);
+    *len = info.st_size;
+    return contents;
+}
 
-        edge_t edges[NUM_EDGES];
-        get_edges(tile, edges);
-        for(int j = 0; j < NUM_EDGES; j++) {
-            edge_t *edge;
-            if(NULL != (edge = get_with_flip(edges_map, &edges[j]))) {
-                vector_push_unique(edge->tiles, &tile);
-            } else {
-                edge = &edges[j];
-                edge->tiles = vector_init(sizeof(tile_t *));
-                vector_push(edge->tiles, &tile);
+// The tiles of one part of the input, in arrays that grow as they're read.
+struct parsed_tiles {
+    tile_t *tiles;
+    uint8_t *rows;
+    size_t len;
+    size_t capacity;
+};
 
-                hashmap_set(edges_map, edge);
+struct parse_task {
+    const char *input;
+    const char *input_end;
+    int side;
+    tile_reader_t read_tile;
+    struct parsed_tiles parts[MAX_WORKERS];
+};
+
+static bool is_tile_header(const char *cursor, const char *input_end) {
+    return input_end - cursor >= 5 && 0 == memcmp(cursor, "Tile ", 5);
+}
+
+// Finds the first "Tile " that starts before `end`, looking for its 'T' 16
+// bytes at a time with SSE2 when it's available.
+static const char *find_tile_header(const char *cursor, const char *end,
+                                    const char *input_end) {
+#ifdef __SSE2__
+    const __m128i letter = _mm_set1_epi8('T');
+    for(; end - cursor >= 16 && input_end - cursor >= 16; cursor += 16) {
+        __m128i chunk = _mm_loadu_si128((const __m128i *)cursor);
+        unsigned found = _mm_movemask_epi8(_mm_cmpeq_epi8(chunk, letter));
+        while(found != 0) {
+            const char *header = cursor + __builtin_ctz(found);
+            if(is_tile_header(header, input_end)) {
+                return header;
             }
+            found &= found - 1;
+        }
+    }
+#endif
+    for(; cursor < end; cursor++) {
+        if(*cursor == 'T' && is_tile_header(cursor, input_end)) {
+            return cursor;
         }
     }
+    return NULL;
+}
 
-    fclose(input);
+// Every part gets a range of the input, and the tiles whose "Tile " starts in
+// that range. Its tiles are read in a single pass.
+static void read_part_tiles(void *context, int part, int parts) {
+    struct parse_task *task = context;
+    struct parsed_tiles *parsed = &task->parts[part];
+    size_t input_len = task->input_end - task->input;
+    const char *start = task->input + input_len * part / parts;
+    const char *end = task->input + input_len * (part + 1) / parts;
+
+    // a guess from the size of a tile, which is corrected as the arrays grow.
+    parsed->capacity = (end - start) / (task->side * (task->side + 1)) + 1;
+    parsed->len = 0;
+    parsed->tiles = malloc(parsed->capacity * sizeof(tile_t));
+    size_t tile_bytes = task->side * row_bytes(task->side);
+    parsed->rows = malloc(parsed->capacity * tile_bytes);
+    assert(NULL != parsed->tiles && NULL != parsed->rows);
+
+    const char *cursor = find_tile_header(start, end, task->input_end);
+    while(NULL != cursor) {
+        if(parsed->len == parsed->capacity) {
+            parsed->capacity *= 2;
+            parsed->tiles =
+                realloc(parsed->tiles, parsed->capacity * sizeof(tile_t));
+            parsed->rows =
+                realloc(parsed->rows, parsed->capacity * tile_bytes);
+            assert(NULL != parsed->tiles && NULL != parsed->rows);
+        }
+        tile_t *tile = &parsed->tiles[parsed->len];
+        uint8_t *rows = &parsed->rows[parsed->len * tile_bytes];
+        parsed->len++;
+
+        tile->id = 0;
+        for(cursor += strlen("Tile ");
+            cursor < task->input_end && *cursor >= '0' && *cursor <= '9';
+            cursor++) {
+            tile->id = tile->id * 10 + (*cursor - '0');
+        }
+        cursor = memchr(cursor, '\n', task->input_end - cursor);
+        assert(NULL != cursor);
+
+        cursor = task->read_tile(cursor + 1, task->input_end, tile, rows,
+                                 task->side);
+        cursor = find_tile_header(cursor, end, task->input_end);
+    }
+}
+
+// The tile side is the length of the first tile's first row, and every tile
+// is read with a reader specialized for that side when there is one. The parts
+// of the input are read in parallel, then their tiles are put together.
+static void parse(puzzle_t *puzzle) {
+    struct parse_task task = {0};
+    size_t input_len;
+    task.input = map_file("inputs/day20.txt", &input_len);
+    task.input_end = task.input + input_len;
+
+    const char *first_row = memchr(task.input, '\n', input_len);
+    assert(NULL != first_row);
+    first_row++;
+    while(first_row + task.side < task.input_end &&
+          first_row[task.side] != '\n' && first_row[task.side] != '\r') {
+        task.side++;
+    }
+    if(task.side < 3 || task.side > MAX_TILE_SIDE) {
+        printf("Unsupported tile side %d! Exiting.\n", task.side);
+        exit(1);
+    }
+    task.read_tile = select_tile_reader(task.side);
+
+    int parts = count_workers(input_len, MIN_BYTES_PER_WORKER);
+    run_parallel(read_part_tiles, &task, parts);
+
+    // the first part's arrays are grown to hold all the tiles.
+    puzzle->side = task.side;
+    puzzle->len = 0;
+    for(int part = 0; part < parts; part++) {
+        puzzle->len += task.parts[part].len;
+    }
+    puzzle->tiles =
+        realloc(task.parts[0].tiles, (puzzle->len + 1) * sizeof(tile_t));
+    size_t tile_bytes = task.side * row_bytes(task.side);
+    puzzle->rows =
+        realloc(task.parts[0].rows, (puzzle->len + 1) * tile_bytes);
+    assert(NULL != puzzle->tiles && NULL != puzzle->rows);
+
+    size_t len = task.parts[0].len;
+    for(int part = 1; part < parts; part++) {
+        struct parsed_tiles *parsed = &task.parts[part];
+        memcpy(&puzzle->tiles[len], parsed->tiles,
+               parsed->len * sizeof(tile_t));
+        memcpy(&puzzle->rows[len * tile_bytes], parsed->rows,
+               parsed->len * tile_bytes);
+        len += parsed->len;
+        free(parsed->tiles);
+        free(parsed->rows);
+    }
+
+    munmap((void *)task.input, input_len);
+}
+
+static inline int row_bytes(int side) {
+    return side <= 8 ? 1 : side <= 16 ? 2 : side <= 32 ? 4 : 8;
+}
+
+// Stores row r of a tile's rows at their narrow width.
+static inline __attribute__((always_inline)) void
+store_row(uint8_t *rows, int side, int r, tilerow_t row) {
+    switch(row_bytes(side)) {
+    case 1:
+        rows[r] = row;
+        break;
+    case 2:
+        ((uint16_t *)rows)[r] = row;
+        break;
+    case 4:
+        ((uint32_t *)rows)[r] = row;
+        break;
+    default:
+        ((uint64_t *)rows)[r] = row;
+    }
+}
+
+static inline tilerow_t load_row(const uint8_t *rows, int side, int r) {
+    switch(row_bytes(side)) {
+    case 1:
+        return rows[r];
+    case 2:
+        return ((const uint16_t *)rows)[r];
+    case 4:
+        return ((const uint32_t *)rows)[r];
+    default:
+        return ((const uint64_t *)rows)[r];
+    }
+}
+
+// Converts a row of '#' and '.' to bits. With SSE2, 16 pixels are compared at
+// a time, as long as that doesn't read past the end of the input.
+static inline __attribute__((always_inline)) tilerow_t
+read_tile_row(const char *cursor, const char *input_end, int side) {
+    // bit c is set for a '#' (or a '.') in column c.
+    uint64_t hashes = 0, dots = 0;
+    int c = 0;
+#ifdef __SSE2__
+    const __m128i hash = _mm_set1_epi8('#'), dot = _mm_set1_epi8('.');
+    for(; c < side && input_end - (cursor + c) >= 16; c += 16) {
+        __m128i chunk = _mm_loadu_si128((const __m128i *)(cursor + c));
+        hashes |= (uint64_t)_mm_movemask_epi8(_mm_cmpeq_epi8(chunk, hash))
+                  << c;
+        dots |= (uint64_t)_mm_movemask_epi8(_mm_cmpeq_epi8(chunk, dot)) << c;
+    }
+#endif
+    for(; c < side && cursor + c < input_end; c++) {
+        hashes |= (uint64_t)(cursor[c] == '#') << c;
+        dots |= (uint64_t)(cursor[c] == '.') << c;
+    }
+
+    uint64_t columns = side == 64 ? ~(uint64_t)0 : ((uint64_t)1 << side) - 1;
+    assert(((hashes | dots) & columns) == columns);
+    return reverse_bits(hashes & columns) >> (64 - side);
+}
+
+// Reads the rows of a tile, stores them at their narrow width, then computes
+// its edges. Always inlined, so that every specialized reader below is
+// compiled with a constant side.
+static inline __attribute__((always_inline)) const char *
+read_tile_rows(const char *cursor, const char *input_end, tile_t *tile,
+               uint8_t *stored, int side) {
+    tilerow_t rows[MAX_TILE_SIDE];
+    for(int r = 0; r < side; r++) {
+        rows[r] = read_tile_row(cursor, input_end, side);
+        store_row(stored, side, r, rows[r]);
+
+        cursor += side;
+        if(cursor < input_end && *cursor == '\r') {
+            cursor++;
+        }
+        assert(cursor == input_end || *cursor == '\n');
+        if(cursor < input_end) {
+            cursor++;
+        }
+    }
+
+    get_edges(rows, side, tile->codes);
+    return cursor;
+}
+
+#define TILE_READER(n)                                                         \
+    static const char *read_tile_##n(const char *cursor,                       \
+                                     const char *input_end, tile_t *tile,      \
+                                     uint8_t *rows, int side) {                \
+        return read_tile_rows(cursor, input_end, tile, rows, n);               \
+    }
+
+TILE_READER(8)
+TILE_READER(10)
+TILE_READER(12)
+TILE_READER(16)
+TILE_READER(32)
+TILE_READER(64)
+
+static const char *read_tile_generic(const char *cursor,
+                                     const char *input_end, tile_t *tile,
+                                     uint8_t *rows, int side) {
+    return read_tile_rows(cursor, input_end, tile, rows, side);
+}
+
+static tile_reader_t select_tile_reader(int side) {
+    switch(side) {
+    case 8:
+        return read_tile_8;
+    case 10:
+        return read_tile_10;
+    case 12:
+        return read_tile_12;
+    case 16:
+        return read_tile_16;
+    case 32:
+        return read_tile_32;
+    case 64:
+        return read_tile_64;
+    default:
+        return read_tile_generic;
+    }
+}
+
+// The canonical codes of a tile's edges, without repeats, so that a tile is
+// listed only once under each of its edges. Returns how many there are.
+static int tile_edge_keys(const tile_t *tile, int side, edgecode_t keys[]) {
+    int len = 0;
+    for(int j = 0; j < NUM_EDGES; j++) {
+        edgecode_t key = canonical_code(tile->codes[j], side);
+
+        bool repeated = false;
+        for(int k = 0; k < len; k++) {
+            repeated = repeated || keys[k] == key;
+        }
+        if(!repeated) {
+            keys[len++] = key;
+        }
+    }
+    return len;
+}
+
+struct edge_entry {
+    edgecode_t code;
+    uint32_t tile;
+};
+
+struct index_task {
+    const puzzle_t *puzzle;
+    edge_index_t *index;
+    // a histogram per part, which then holds where each part's entries go.
+    uint32_t *counts;
+    size_t buckets;
+    // only used for sorted indexes.
+    struct edge_entry *entries;
+    struct edge_entry *sorted;
+    size_t first_entry[MAX_WORKERS + 1];
+    int shift;
+};
+
+static void count_part_slots(void *context, int part, int parts) {
+    struct index_task *task = context;
+    const puzzle_t *puzzle = task->puzzle;
+    uint32_t *counts = &task->counts[part * task->buckets];
+
+    edgecode_t keys[NUM_EDGES];
+    for(size_t i = puzzle->len * part / parts;
+        i < puzzle->len * (part + 1) / parts; i++) {
+        int len = tile_edge_keys(&puzzle->tiles[i], puzzle->side, keys);
+        for(int j = 0; j < len; j++) {
+            counts[keys[j]]++;
+        }
+    }
+}
+
+static void fill_part_slots(void *context, int part, int parts) {
+    struct index_task *task = context;
+    const puzzle_t *puzzle = task->puzzle;
+    uint32_t *next = &task->counts[part * task->buckets];
+
+    edgecode_t keys[NUM_EDGES];
+    for(size_t i = puzzle->len * part / parts;
+        i < puzzle->len * (part + 1) / parts; i++) {
+        int len = tile_edge_keys(&puzzle->tiles[i], puzzle->side, keys);
+        for(int j = 0; j < len; j++) {
+            task->index->tile_ids[next[keys[j]]++] = i;
+        }
+    }
+}
+
+static void count_part_entries(void *context, int part, int parts) {
+    struct index_task *task = context;
+    const puzzle_t *puzzle = task->puzzle;
+
+    size_t entries = 0;
+    edgecode_t keys[NUM_EDGES];
+    for(size_t i = puzzle->len * part / parts;
+        i < puzzle->len * (part + 1) / parts; i++) {
+        entries += tile_edge_keys(&puzzle->tiles[i], puzzle->side, keys);
+    }
+    task->first_entry[part + 1] = entries;
+}
+
+static void fill_part_entries(void *context, int part, int parts) {
+    struct index_task *task = context;
+    const puzzle_t *puzzle = task->puzzle;
+    struct edge_entry *entry = &task->entries[task->first_entry[part]];
+
+    edgecode_t keys[NUM_EDGES];
+    for(size_t i = puzzle->len * part / parts;
+        i < puzzle->len * (part + 1) / parts; i++) {
+        int len = tile_edge_keys(&puzzle->tiles[i], puzzle->side, keys);
+        for(int j = 0; j < len; j++) {
+            *entry++ = (struct edge_entry){keys[j], i};
+        }
+    }
+}
+
+static size_t radix_digit(const struct index_task *task,
+                          const struct edge_entry *entry) {
+    return (entry->code >> task->shift) & (task->buckets - 1);
+}
+
+static void count_part_digits(void *context, int part, int parts) {
+    struct index_task *task = context;
+    size_t entries = task->first_entry[parts];
+    uint32_t *counts = &task->counts[part * task->buckets];
+
+    memset(counts, 0, task->buckets * sizeof(uint32_t));
+    for(size_t i = entries * part / parts; i < entries * (part + 1) / parts;
+        i++) {
+        counts[radix_digit(task, &task->entries[i])]++;
+    }
+}
+
+static void scatter_part_digits(void *context, int part, int parts) {
+    struct index_task *task = context;
+    size_t entries = task->first_entry[parts];
+    uint32_t *next = &task->counts[part * task->buckets];
+
+    for(size_t i = entries * part / parts; i < entries * (part + 1) / parts;
+        i++) {
+        task->sorted[next[radix_digit(task, &task->entries[i])]++] =
+            task->entries[i];
+    }
+}
+
+// Turns per-part histograms into the position of each part's first item in
+// every bucket, with the parts of a bucket in order, and the start of every
+// bucket into bucket_offsets (if not NULL). Returns the number of items.
+static size_t histogram_offsets(uint32_t *counts, size_t buckets, int parts,
+                                uint32_t *bucket_offsets, size_t *nonempty) {
+    size_t total = 0;
+    *nonempty = 0;
+    for(size_t bucket = 0; bucket < buckets; bucket++) {
+        if(NULL != bucket_offsets) {
+            bucket_offsets[bucket] = total;
+        }
+
+        size_t start = total;
+        for(int part = 0; part < parts; part++) {
+            uint32_t count = counts[part * buckets + bucket];
+            counts[part * buckets + bucket] = total;
+            total += count;
+        }
+        if(total > start) {
+            (*nonempty)++;
+        }
+    }
+    return total;
+}
+
+// Both layouts take memory linear in the number of tiles (plus the table of
+// 2^side slots for small sides), and list the tiles of a slot in order. Each
+// part of the tiles is counted into its own histogram, and once the counts
+// are summed up into offsets, every part writes its own entries, so no two
+// threads ever write to the same place. Larger sides sort the (code, tile)
+// entries with an LSD radix sort, a digit at a time in the same way.
+static void build_edge_index(const puzzle_t *puzzle, edge_index_t *index) {
+    struct index_task task = {.puzzle = puzzle, .index = index};
+    int parts = count_workers(puzzle->len, MIN_TILES_PER_WORKER);
+
+    index->side = puzzle->side;
+    if(puzzle->side <= DIRECT_INDEX_SIDE) {
+        index->codes = NULL;
+        index->slots = (size_t)1 << puzzle->side;
+        index->offsets = malloc((index->slots + 1) * sizeof(uint32_t));
+        task.buckets = index->slots;
+        task.counts = calloc(parts * task.buckets, sizeof(uint32_t));
+        assert(NULL != index->offsets && NULL != task.counts);
+
+        run_parallel(count_part_slots, &task, parts);
+        size_t entries = histogram_offsets(task.counts, task.buckets, parts,
+                                           index->offsets, &index->unique);
+        index->offsets[index->slots] = entries;
+
+        index->tile_ids = malloc(entries * sizeof(uint32_t));
+        assert(NULL != index->tile_ids);
+        run_parallel(fill_part_slots, &task, parts);
+
+        free(task.counts);
+        return;
+    }
+
+    run_parallel(count_part_entries, &task, parts);
+    for(int part = 0; part < parts; part++) {
+        task.first_entry[part + 1] += task.first_entry[part];
+    }
+    size_t entries = task.first_entry[parts];
+
+    task.entries = malloc(entries * sizeof(struct edge_entry));
+    task.sorted = malloc(entries * sizeof(struct edge_entry));
+    task.buckets = 1 << RADIX_BITS;
+    task.counts = malloc(parts * task.buckets * sizeof(uint32_t));
+    assert(NULL != task.entries && NULL != task.sorted && NULL != task.counts);
+    run_parallel(fill_part_entries, &task, parts);
+
+    // the sort is stable, so the tiles of a code stay in order.
+    for(task.shift = 0; task.shift < puzzle->side; task.shift += RADIX_BITS) {
+        size_t nonempty;
+        run_parallel(count_part_digits, &task, parts);
+        histogram_offsets(task.counts, task.buckets, parts, NULL, &nonempty);
+        run_parallel(scatter_part_digits, &task, parts);
+
+        struct edge_entry *temp = task.entries;
+        task.entries = task.sorted;
+        task.sorted = temp;
+    }
+
+    index->codes = malloc(entries * sizeof(edgecode_t));
+    index->offsets = malloc((entries + 1) * sizeof(uint32_t));
+    index->tile_ids = malloc(entries * sizeof(uint32_t));
+    assert(NULL != index->codes && NULL != index->offsets &&
+           NULL != index->tile_ids);
+    index->unique = 0;
+    for(size_t i = 0; i < entries; i++) {
+        if(i == 0 || task.entries[i].code != task.entries[i - 1].code) {
+            index->codes[index->unique] = task.entries[i].code;
+            index->offsets[index->unique] = i;
+            index->unique++;
+        }
+        index->tile_ids[i] = task.entries[i].tile;
+    }
+    index->slots = index->unique;
+    index->offsets[index->slots] = entries;
+
+    free(task.entries);
+    free(task.sorted);
+    free(task.counts);
+}
+
+static const uint32_t *get_edge_tiles(const edge_index_t *index,
+                                      edgecode_t code, size_t *count) {
+    code = canonical_code(code, index->side);
+
+    size_t slot = code;
+    if(NULL != index->codes) {
+        size_t low = 0, high = index->slots;
+        while(low < high) {
+            size_t middle = low + (high - low) / 2;
+            if(index->codes[middle] < code) {
+                low = middle + 1;
+            } else {
+                high = middle;
+            }
+        }
+        if(low == index->slots || index->codes[low] != code) {
+            *count = 0;
+            return NULL;
+        }
+        slot = low;
+    }
+
+    *count = index->offsets[slot + 1] - index->offsets[slot];
+    return &index->tile_ids[index->offsets[slot]];
+}
+
+static uint64_t reverse_bits(uint64_t bits) {
+    bits = ((bits >> 1) & 0x5555555555555555ull) |
+           ((bits & 0x5555555555555555ull) << 1);
+    bits = ((bits >> 2) & 0x3333333333333333ull) |
+           ((bits & 0x3333333333333333ull) << 2);
+    bits = ((bits >> 4) & 0x0F0F0F0F0F0F0F0Full) |
+           ((bits & 0x0F0F0F0F0F0F0F0Full) << 4);
+    bits = ((bits >> 8) & 0x00FF00FF00FF00FFull) |
+           ((bits & 0x00FF00FF00FF00FFull) << 8);
+    bits = ((bits >> 16) & 0x0000FFFF0000FFFFull) |
+           ((bits & 0x0000FFFF0000FFFFull) << 16);
+    return (bits >> 32) | (bits << 32);
+}
+
+static edgecode_t reverse_code(edgecode_t code, int side) {
+    return reverse_bits(code) >> (64 - side);
+}
+
+// Edges go clockwise around the tile: top, right, bottom, left.
+static void get_edges(const tilerow_t rows[], int side, edgecode_t codes[]) {
+    edgecode_t first_column = 0, last_column = 0;
+    for(int i = 0; i < side; i++) {
+        first_column = (first_column << 1) | (rows[i] >> (side - 1));
+        last_column = (last_column << 1) | (rows[i] & 1);
+    }
+
+    codes[0] = rows[0];
+    codes[1] = last_column;
+    codes[2] = reverse_code(rows[side - 1], side);
+    codes[3] = reverse_code(first_column, side);
+    for(int i = 0; i < NUM_EDGES; i++) {
+        codes[NUM_EDGES + i] = reverse_code(codes[i], side);
+    }
 }
 
-// Assuming that the file cursor is at the position
-// where the 'T' from "Tile" is
-static void parse_tile(FILE *input, tile_t *tile) {
-    fscanf(input, "Tile %d:\n", &(tile->id));
-    for(int i = 0; i < TILE_SIDE; i++) {
-        for(int j = 0; j < TILE_SIDE; j++) {
-            int c = fgetc(input);
-            assert(c != EOF);
-            assert(c == '#' || c == '.');
+// Transposes a 64x64 bit matrix whose rows start at the most significant bit,
+// by swapping the off-diagonal blocks of ever smaller sizes.
+static void transpose64(uint64_t matrix[64]) {
+    uint64_t mask = 0x00000000FFFFFFFFull;
+    for(int size = 32; size != 0; size >>= 1, mask ^= mask << size) {
+        for(int k = 0; k < 64; k = ((k | size) + 1) & ~size) {
+            uint64_t swapped = (matrix[k] ^ (matrix[k | size] >> size)) & mask;
+            matrix[k] ^= swapped;
+            matrix[k | size] ^= swapped << size;
+        }
+    }
+}
 
-            char ch = c;
-            tile->info[i][j] = (ch == '#');
+// A flip reverses every row, and a clockwise rotation is a transpose followed
+// by a flip. The rows are moved to the top of a 64x64 matrix to transpose.
+static void orient_rows(const tilerow_t rows[], int side, int orientation,
+                        tilerow_t oriented[]) {
+    uint64_t matrix[64] = {0};
+    for(int i = 0; i < side; i++) {
+        tilerow_t row = rows[i];
+        if(orientation >= 4) {
+            row = reverse_code(row, side);
         }
-        fseek(input, 1, SEEK_CUR); // Because newline
+        matrix[i] = row << (64 - side);
+    }
+
+    for(int rotation = 0; rotation < orientation % 4; rotation++) {
+        transpose64(matrix);
+        for(int i = 0; i < side; i++) {
+            matrix[i] = reverse_bits(matrix[i]) << (64 - side);
+        }
+    }
+
+    for(int i = 0; i < side; i++) {
+        oriented[i] = matrix[i] >> (64 - side);
+    }
+}
+
+// Returns the tile that shares the edge with `tile`, or NULL if there's none
+// or if there's more than one.
+static tile_t *other_tile(const edge_index_t *index, const puzzle_t *puzzle,
+                          edgecode_t code, const tile_t *tile) {
+    size_t count;
+    const uint32_t *found = get_edge_tiles(index, code, &count);
+    assert(count > 0);
+    if(count > 2) {
+        return NULL;
     }
 
-    fseek(input, 1, SEEK_CUR); // ending newline
+    for(size_t i = 0; i < count; i++) {
+        if(&puzzle->tiles[found[i]] != tile) {
+            return &puzzle->tiles[found[i]];
+        }
+    }
+    return NULL;
 }
 
-static edge_t flip_edge(edge_t edge) {
-    edge_t new_edge;
-    new_edge.tiles = edge.tiles;
-    for(int i = 0; i < TILE_SIDE; i++) {
-        new_edge.edge[i] = edge.edge[TILE_SIDE - i - 1];
+// Finds an orientation of `tile` whose top and left edges are `top` and
+// `left`, in clockwise order. An edge of -1 matches only edges that aren't
+// shared with any other tile. Returns -1 if there's no such orientation.
+static int find_orientation(const edge_index_t *index, const tile_t *tile,
+                            int64_t top, int64_t left) {
+    for(int orientation = 0; orientation < NUM_ORIENTATIONS; orientation++) {
+        edgecode_t oriented_top = oriented_edge(tile, orientation, 0);
+        edgecode_t oriented_left = oriented_edge(tile, orientation, 3);
+
+        bool top_ok = top == -1 ? edge_tile_count(index, oriented_top) == 1
+                                : oriented_top == (edgecode_t)top;
+        bool left_ok = left == -1 ? edge_tile_count(index, oriented_left) == 1
+                                  : oriented_left == (edgecode_t)left;
+        if(top_ok && left_ok) {
+            return orientation;
+        }
     }
 
-    return new_edge;
+    return -1;
 }
 
-static edge_t *get_with_flip(hashmap_t *edges_map, edge_t *edge) {
-    edge_t *gotten;
-    if(NULL != (gotten = hashmap_get(edges_map, edge))) {
-        return gotten;
+static edgecode_t placed_edge(const tilematrix_t *matrix, size_t position,
+                              int direction) {
+    int orientation =
+        matrix->tiles[position].rotation + 4 * matrix->tiles[position].flipped;
+    return oriented_edge(matrix->tiles[position].source, orientation,
+                         direction);
+}
+
+static void init_tilematrix(tilematrix_t *matrix, size_t tiles_len) {
+    matrix->side = 0;
+    while(matrix->side * matrix->side < tiles_len) {
+        matrix->side++;
+    }
+    if(matrix->side * matrix->side != tiles_len) {
+        printf("%zu tiles don't make a square! Exiting.\n", tiles_len);
+        exit(1);
+    }
+    matrix->tiles = calloc(tiles_len, sizeof(*matrix->tiles));
+    assert(NULL != matrix->tiles);
+}
+
+// Places every tile, starting with a corner in the top left, then going row
+// by row. Each tile is found by looking up the edge it shares with the tile
+// to its left (or above it, in the first column), so the whole assembly takes
+// linear time. This relies on every edge being shared by at most two tiles,
+// and returns false when that's not the case.
+static bool assemble(const edge_index_t *index, const puzzle_t *puzzle,
+                     tilematrix_t *matrix) {
+    for(size_t row = 0; row < matrix->side; row++) {
+        for(size_t col = 0; col < matrix->side; col++) {
+            size_t position = row * matrix->side + col;
+            tile_t *tile = NULL;
+
+            // two tiles share an edge when one's code is the reverse of the
+            // other's, since both are read clockwise.
+            int64_t top = -1, left = -1;
+            if(col > 0) {
+                edgecode_t right = placed_edge(matrix, position - 1, 1);
+                left = reverse_code(right, puzzle->side);
+                tile = other_tile(index, puzzle, right,
+                                  matrix->tiles[position - 1].source);
+            }
+            if(row > 0) {
+                edgecode_t bottom =
+                    placed_edge(matrix, position - matrix->side, 2);
+                top = reverse_code(bottom, puzzle->side);
+                if(NULL == tile) {
+                    tile = other_tile(index, puzzle, bottom,
+                                      matrix->tiles[position - matrix->side]
+                                          .source);
+                }
+            }
+
+            if(position == 0) { // the top left corner
+                for(size_t i = 0; i < puzzle->len && NULL == tile; i++) {
+                    int unmatched = 0;
+                    for(int j = 0; j < NUM_EDGES; j++) {
+                        if(edge_tile_count(index, puzzle->tiles[i].codes[j]) ==
+                           1) {
+                            unmatched++;
+                        }
+                    }
+                    if(unmatched == 2) {
+                        tile = &puzzle->tiles[i];
+                    }
+                }
+            }
+            if(NULL == tile) {
+                return false;
+            }
+
+            int orientation = find_orientation(index, tile, top, left);
+            if(orientation == -1) {
+                return false;
+            }
+            matrix->tiles[position].source = tile;
+            matrix->tiles[position].rotation = orientation % 4;
+            matrix->tiles[position].flipped = orientation >= 4;
+        }
     }
+    return true;
+}
+
+// One tile of a partial assembly, placed in a slot in an orientation.
+struct placement {
+    uint32_t tile;
+    uint32_t slot;
+    uint8_t orientation;
+};
+
+// A subtree of the search: every assembly that starts with these placements,
+// in this order.
+struct search_task {
+    size_t depth;
+    struct placement placements[];
+};
+
+// The owner pushes and pops tasks at the tail, and other workers steal from
+// the head, where the largest subtrees are.
+struct task_deque {
+    pthread_mutex_t lock;
+    struct search_task **tasks;
+    size_t head, tail, capacity;
+};
 
-    edge_t flipped = flip_edge(*edge);
-    return hashmap_get(edges_map, &flipped);
+// The candidates left for a slot: the tiles that share the edge of a placed
+// neighbour, each tried in every orientation.
+struct search_cursor {
+    const uint32_t *ids; // NULL for the first slot
+    size_t count;
+    size_t next;
+    int orientation;
+    uint32_t slot;
+    int64_t need[NUM_EDGES]; // the edges the slot needs, or -1 for any
+};
+
+struct search {
+    const edge_index_t *index;
+    const puzzle_t *puzzle;
+    size_t side;
+    size_t slots;
+    // the candidates for the first slot, corner-like orientations first.
+    struct placement *first;
+    size_t first_len;
+    struct task_deque deques[MAX_WORKERS];
+    int workers;
+    atomic_size_t pending; // tasks queued or being explored
+    atomic_int idle;
+    atomic_bool found;
+    atomic_size_t tried;
+    pthread_mutex_t solution_lock;
+    struct placement *solution;
+};
+
+// The state of one worker while it explores a task. The open slots next to a
+// placed tile are the frontier, and each of them keeps a count of the
+// candidates (tile and orientation) that still fit it.
+struct search_worker {
+    struct search *search;
+    int part;
+    bool *used;
+    struct placement *placements; // by depth
+    struct search_cursor *cursors; // by depth
+    int32_t *depths; // by slot: the depth of its placement, or -1
+    uint8_t *neighbours; // by slot: how many of its neighbours are placed
+    uint32_t *counts; // by slot, for the frontier only
+    uint32_t *frontier;
+    uint32_t *frontier_pos; // by slot
+    size_t frontier_len;
+};
+
+static struct search_task *new_search_task(const struct placement placements[],
+                                           size_t depth) {
+    struct search_task *task =
+        malloc(sizeof(struct search_task) + depth * sizeof(struct placement));
+    assert(NULL != task);
+    task->depth = depth;
+    if(depth > 0) {
+        memcpy(task->placements, placements, depth * sizeof(struct placement));
+    }
+    return task;
 }
 
-static void get_edges(const tile_t *tile, edge_t edges[]) {
-    for(int i = 0; i < TILE_SIDE; i++) {
-        edges[0].edge[i] = tile->info[0][i];
-        edges[1].edge[i] = tile->info[i][TILE_SIDE - 1];
-        edges[2].edge[i] = tile->info[TILE_SIDE - 1][TILE_SIDE - 1 - i];
-        edges[3].edge[i] = tile->info[TILE_SIDE - 1 - i][0];
+static void push_search_task(struct search *search, int part,
+                             struct search_task *task) {
+    struct task_deque *deque = &search->deques[part];
+    atomic_fetch_add(&search->pending, 1);
+
+    pthread_mutex_lock(&deque->lock);
+    if(deque->tail == deque->capacity) {
+        deque->capacity = deque->capacity == 0 ? 16 : deque->capacity * 2;
+        deque->tasks =
+            realloc(deque->tasks, deque->capacity * sizeof(*deque->tasks));
+        assert(NULL != deque->tasks);
     }
+    deque->tasks[deque->tail++] = task;
+    pthread_mutex_unlock(&deque->lock);
 }
 
-static int count_tiles(FILE *file) {
-    int counter = 0;
+// Takes the newest task of the worker's own deque, or steals the oldest task
+// of another worker's.
+static struct search_task *take_search_task(struct search *search, int part) {
+    struct search_task *task = NULL;
+    for(int i = 0; i < search->workers && NULL == task; i++) {
+        struct task_deque *deque =
+            &search->deques[(part + i) % search->workers];
 
-    int c;
-    while((c = fgetc(file)) != EOF) {
-        char ch = c;
-        if(ch == 'T') {
-            counter++;
+        pthread_mutex_lock(&deque->lock);
+        if(deque->head < deque->tail) {
+            task = i == 0 ? deque->tasks[--deque->tail]
+                          : deque->tasks[deque->head++];
+            if(deque->head == deque->tail) {
+                deque->head = deque->tail = 0;
+            }
         }
+        pthread_mutex_unlock(&deque->lock);
     }
+    return task;
+}
+
+static bool deque_is_empty(struct search *search, int part) {
+    struct task_deque *deque = &search->deques[part];
+    pthread_mutex_lock(&deque->lock);
+    bool empty = deque->head == deque->tail;
+    pthread_mutex_unlock(&deque->lock);
+    return empty;
+}
 
-    rewind(file);
-    return counter;
+static edgecode_t placement_edge(const struct search *search,
+                                 struct placement placement, int direction) {
+    return oriented_edge(&search->puzzle->tiles[placement.tile],
+                         placement.orientation, direction);
+}
+
+// The slot next to `slot` in the given direction (0-3, clockwise from the
+// top), or -1 at the border.
+static int64_t neighbour_slot(const struct search *search, size_t slot,
+                              int direction) {
+    size_t row = slot / search->side, col = slot % search->side;
+    switch(direction) {
+    case 0:
+        return row > 0 ? (int64_t)(slot - search->side) : -1;
+    case 1:
+        return col + 1 < search->side ? (int64_t)(slot + 1) : -1;
+    case 2:
+        return row + 1 < search->side ? (int64_t)(slot + search->side) : -1;
+    default:
+        return col > 0 ? (int64_t)(slot - 1) : -1;
+    }
 }
 
-static bool edge_vector_freer(const void *edge_void, void *udata) {
-    const edge_t *edge = edge_void;
+// The edges an open slot needs in each direction, or -1 where its neighbour
+// isn't placed. Returns a direction that has a placed neighbour, or -1.
+static int slot_needs(const struct search_worker *worker, size_t slot,
+                      int64_t need[NUM_EDGES]) {
+    const struct search *search = worker->search;
+    int constrained = -1;
+    for(int direction = 0; direction < NUM_EDGES; direction++) {
+        int64_t neighbour = neighbour_slot(search, slot, direction);
+        need[direction] = -1;
+        if(neighbour == -1 || worker->depths[neighbour] == -1) {
+            continue;
+        }
 
-    if(NULL != edge->tiles) {
-        vector_free(edge->tiles);
+        // two tiles share an edge when one's code is the reverse of the
+        // other's.
+        edgecode_t code = placement_edge(
+            search, worker->placements[worker->depths[neighbour]],
+            (direction + 2) % NUM_EDGES);
+        need[direction] = reverse_code(code, search->puzzle->side);
+        constrained = direction;
     }
+    return constrained;
+}
 
+static bool placement_fits(const struct search *search,
+                           struct placement placement,
+                           const int64_t need[NUM_EDGES]) {
+    for(int direction = 0; direction < NUM_EDGES; direction++) {
+        if(need[direction] != -1 &&
+           placement_edge(search, placement, direction) !=
+               (edgecode_t)need[direction]) {
+            return false;
+        }
+    }
     return true;
 }
+
+// How many orientations of the tile fit a slot that needs these edges.
+static uint32_t count_fits(const struct search *search, uint32_t tile,
+                           const int64_t need[NUM_EDGES]) {
+    uint32_t fits = 0;
+    for(int o = 0; o < NUM_ORIENTATIONS; o++) {
+        fits += placement_fits(search, (struct placement){tile, 0, o}, need);
+    }
+    return fits;
+}
+
+// Counts the candidates of a frontier slot from scratch.
+static uint32_t count_candidates(const struct search_worker *worker,
+                                 size_t slot) {
+    int64_t need[NUM_EDGES];
+    int direction = slot_needs(worker, slot, need);
+    size_t count;
+    const uint32_t *ids =
+        get_edge_tiles(worker->search->index, need[direction], &count);
+
+    uint32_t candidates = 0;
+    for(size_t i = 0; i < count; i++) {
+        if(!worker->used[ids[i]]) {
+            candidates += count_fits(worker->search, ids[i], need);
+        }
+    }
+    return candidates;
+}
+
+static void frontier_add(struct search_worker *worker, uint32_t slot) {
+    worker->frontier_pos[slot] = worker->frontier_len;
+    worker->frontier[worker->frontier_len++] = slot;
+}
+
+static void frontier_remove(struct search_worker *worker, uint32_t slot) {
+    uint32_t last = worker->frontier[--worker->frontier_len];
+    worker->frontier[worker->frontier_pos[slot]] = last;
+    worker->frontier_pos[last] = worker->frontier_pos[slot];
+}
+
+static bool is_neighbour(const struct search *search, size_t a, size_t b) {
+    for(int direction = 0; direction < NUM_EDGES; direction++) {
+        if(neighbour_slot(search, a, direction) == (int64_t)b) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Adds (sign 1) or takes back (sign -1) the candidates that a tile gives the
+// frontier slots that aren't next to `slot`. Their needs don't depend on it.
+static void update_counts(struct search_worker *worker, uint32_t tile,
+                          size_t slot, int sign) {
+    for(size_t i = 0; i < worker->frontier_len; i++) {
+        uint32_t open = worker->frontier[i];
+        if(is_neighbour(worker->search, open, slot)) {
+            continue;
+        }
+        int64_t need[NUM_EDGES];
+        slot_needs(worker, open, need);
+        worker->counts[open] += sign * count_fits(worker->search, tile, need);
+    }
+}
+
+// Places the tile at `depth` in its slot, and updates the frontier and its
+// counts. Returns false if some open slot has no candidates left.
+static bool place_tile(struct search_worker *worker, size_t depth) {
+    struct search *search = worker->search;
+    struct placement placed = worker->placements[depth];
+
+    if(worker->neighbours[placed.slot] > 0) {
+        frontier_remove(worker, placed.slot);
+    }
+    worker->used[placed.tile] = true;
+    worker->depths[placed.slot] = depth;
+    update_counts(worker, placed.tile, placed.slot, -1);
+
+    bool possible = true;
+    for(int direction = 0; direction < NUM_EDGES; direction++) {
+        int64_t neighbour = neighbour_slot(search, placed.slot, direction);
+        if(neighbour == -1 || worker->depths[neighbour] != -1) {
+            continue;
+        }
+        if(worker->neighbours[neighbour]++ == 0) {
+            frontier_add(worker, neighbour);
+        }
+        worker->counts[neighbour] = count_candidates(worker, neighbour);
+    }
+    for(size_t i = 0; i < worker->frontier_len && possible; i++) {
+        possible = worker->counts[worker->frontier[i]] > 0;
+    }
+    return possible;
+}
+
+// Takes back place_tile.
+static void remove_tile(struct search_worker *worker, size_t depth) {
+    struct search *search = worker->search;
+    struct placement placed = worker->placements[depth];
+
+    for(int direction = 0; direction < NUM_EDGES; direction++) {
+        int64_t neighbour = neighbour_slot(search, placed.slot, direction);
+        if(neighbour != -1 && worker->depths[neighbour] == -1 &&
+           --worker->neighbours[neighbour] == 0) {
+            frontier_remove(worker, neighbour);
+        }
+    }
+    worker->used[placed.tile] = false;
+    worker->depths[placed.slot] = -1;
+    update_counts(worker, placed.tile, placed.slot, 1);
+
+    if(worker->neighbours[placed.slot] > 0) {
+        frontier_add(worker, placed.slot);
+        worker->counts[placed.slot] = count_candidates(worker, placed.slot);
+    }
+    for(int direction = 0; direction < NUM_EDGES; direction++) {
+        int64_t neighbour = neighbour_slot(search, placed.slot, direction);
+        if(neighbour != -1 && worker->depths[neighbour] == -1 &&
+           worker->neighbours[neighbour] > 0) {
+            worker->counts[neighbour] = count_candidates(worker, neighbour);
+        }
+    }
+}
+
+// The frontier slot with the fewest candidates, which is where a wrong
+// placement shows the soonest.
+static uint32_t most_constrained_slot(const struct search_worker *worker) {
+    uint32_t best = worker->frontier[0];
+    for(size_t i = 1; i < worker->frontier_len; i++) {
+        uint32_t slot = worker->frontier[i];
+        if(worker->counts[slot] < worker->counts[best]) {
+            best = slot;
+        }
+    }
+    return best;
+}
+
+static void init_search_cursor(struct search_worker *worker, size_t depth) {
+    struct search *search = worker->search;
+    struct search_cursor *cursor = &worker->cursors[depth];
+
+    cursor->next = 0;
+    cursor->orientation = 0;
+    if(depth == 0) {
+        cursor->slot = 0;
+        cursor->ids = NULL;
+        cursor->count = search->first_len;
+        for(int direction = 0; direction < NUM_EDGES; direction++) {
+            cursor->need[direction] = -1;
+        }
+        return;
+    }
+
+    cursor->slot = most_constrained_slot(worker);
+    int direction = slot_needs(worker, cursor->slot, cursor->need);
+    cursor->ids =
+        get_edge_tiles(search->index, cursor->need[direction], &cursor->count);
+}
+
+// Finds the next candidate for a slot that fits its placed neighbours. Tiles
+// that are already placed are skipped only if skip_used is set.
+static bool next_candidate(struct search_worker *worker, size_t depth,
+                           bool skip_used, struct placement *candidate) {
+    struct search *search = worker->search;
+    struct search_cursor *cursor = &worker->cursors[depth];
+
+    while(cursor->next < cursor->count) {
+        if(NULL == cursor->ids) {
+            *candidate = search->first[cursor->next++];
+        } else {
+            candidate->tile = cursor->ids[cursor->next];
+            candidate->slot = cursor->slot;
+            candidate->orientation = cursor->orientation++;
+            if(cursor->orientation == NUM_ORIENTATIONS) {
+                cursor->orientation = 0;
+                cursor->next++;
+            }
+        }
+
+        if(skip_used && worker->used[candidate->tile]) {
+            continue;
+        }
+        if(!placement_fits(search, *candidate, cursor->need)) {
+            continue;
+        }
+        return true;
+    }
+    return false;
+}
+
+// Gives the shallowest untried candidate of this worker's subtree to the
+// other workers, as a task of its own.
+static void share_search_task(struct search_worker *worker, size_t base,
+                              size_t depth) {
+    for(size_t slot = base; slot < depth; slot++) {
+        struct placement candidate;
+        if(next_candidate(worker, slot, false, &candidate)) {
+            struct placement saved = worker->placements[slot];
+            worker->placements[slot] = candidate;
+            push_search_task(worker->search, worker->part,
+                             new_search_task(worker->placements, slot + 1));
+            worker->placements[slot] = saved;
+            return;
+        }
+    }
+}
+
+// Depth-first search of a task's subtree, with an explicit stack of cursors
+// since the assembly can be as deep as there are tiles. Each step fills the
+// slot with the fewest candidates, and a placement that leaves some slot
+// without any is undone at once.
+static void explore_search_task(struct search_worker *worker,
+                                const struct search_task *task) {
+    struct search *search = worker->search;
+
+    // shared candidates aren't checked against the rest of their placements.
+    size_t depth = 0;
+    bool possible = true;
+    for(; depth < task->depth && possible; depth++) {
+        struct placement placement = task->placements[depth];
+        if(worker->used[placement.tile] ||
+           worker->depths[placement.slot] != -1) {
+            possible = false;
+            break;
+        }
+        worker->placements[depth] = placement;
+        possible = place_tile(worker, depth);
+    }
+    size_t base = depth;
+    size_t tried = 0;
+
+    if(possible) {
+        init_search_cursor(worker, depth);
+        while(!atomic_load(&search->found)) {
+            struct placement candidate;
+            if(!next_candidate(worker, depth, true, &candidate)) {
+                if(depth == base) {
+                    break;
+                }
+                depth--;
+                remove_tile(worker, depth);
+                continue;
+            }
+
+            tried++;
+            worker->placements[depth] = candidate;
+            if(!place_tile(worker, depth)) {
+                remove_tile(worker, depth);
+                continue;
+            }
+
+            depth++;
+            if(depth == search->slots) {
+                pthread_mutex_lock(&search->solution_lock);
+                if(!atomic_load(&search->found)) {
+                    memcpy(search->solution, worker->placements,
+                           search->slots * sizeof(struct placement));
+                    atomic_store(&search->found, true);
+                }
+                pthread_mutex_unlock(&search->solution_lock);
+                break;
+            }
+
+            init_search_cursor(worker, depth);
+            if(atomic_load(&search->idle) > 0 &&
+               deque_is_empty(search, worker->part)) {
+                share_search_task(worker, base, depth);
+            }
+        }
+    }
+
+    while(depth > 0) {
+        remove_tile(worker, --depth);
+    }
+    atomic_fetch_add(&search->tried, tried);
+}
+
+static void search_part(void *context, int part, int parts) {
+    struct search_worker worker = {.search = context, .part = part};
+    struct search *search = worker.search;
+    worker.used = calloc(search->puzzle->len, sizeof(bool));
+    worker.placements = malloc(search->slots * sizeof(struct placement));
+    worker.cursors = malloc(search->slots * sizeof(struct search_cursor));
+    worker.depths = malloc(search->slots * sizeof(int32_t));
+    worker.neighbours = calloc(search->slots, sizeof(uint8_t));
+    worker.counts = calloc(search->slots, sizeof(uint32_t));
+    worker.frontier = malloc(search->slots * sizeof(uint32_t));
+    worker.frontier_pos = malloc(search->slots * sizeof(uint32_t));
+    assert(NULL != worker.used && NULL != worker.placements &&
+           NULL != worker.cursors && NULL != worker.depths &&
+           NULL != worker.neighbours && NULL != worker.counts &&
+           NULL != worker.frontier && NULL != worker.frontier_pos);
+    for(size_t slot = 0; slot < search->slots; slot++) {
+        worker.depths[slot] = -1;
+    }
+
+    bool idle = false;
+    while(!atomic_load(&search->found) && atomic_load(&search->pending) > 0) {
+        struct search_task *task = take_search_task(search, part);
+        if(NULL == task) {
+            if(!idle) {
+                idle = true;
+                atomic_fetch_add(&search->idle, 1);
+            }
+            sched_yield();
+            continue;
+        }
+        if(idle) {
+            idle = false;
+            atomic_fetch_sub(&search->idle, 1);
+        }
+
+        explore_search_task(&worker, task);
+        free(task);
+        atomic_fetch_sub(&search->pending, 1);
+    }
+    if(idle) {
+        atomic_fetch_sub(&search->idle, 1);
+    }
+
+    free(worker.used);
+    free(worker.placements);
+    free(worker.cursors);
+    free(worker.depths);
+    free(worker.neighbours);
+    free(worker.counts);
+    free(worker.frontier);
+    free(worker.frontier_pos);
+}
+
+// Searches for an assembly by backtracking, for puzzles where an edge can be
+// shared by more than two tiles. The top left corner is placed first, then
+// always the open slot with the fewest candidates. Idle workers steal
+// untried subtrees from busy ones, and every worker stops once one of them
+// has a full assembly.
+// The search is still exponential in the worst case. When most edges are
+// shared by several tiles, which happens with random borders of 8 pixels,
+// grids of up to 14x14 take a few seconds but most 16x16 ones take minutes.
+static bool search_assembly(const edge_index_t *index, const puzzle_t *puzzle,
+                            tilematrix_t *matrix) {
+    struct search *search = calloc(1, sizeof(struct search));
+    assert(NULL != search);
+    search->index = index;
+    search->puzzle = puzzle;
+    search->side = matrix->side;
+    search->slots = puzzle->len;
+    search->workers = count_workers(puzzle->len, 1);
+    pthread_mutex_init(&search->solution_lock, NULL);
+    search->solution = malloc(search->slots * sizeof(struct placement));
+    assert(NULL != search->solution);
+
+    // the top left corner most likely has unshared top and left edges.
+    search->first_len = puzzle->len * NUM_ORIENTATIONS;
+    search->first = malloc(search->first_len * sizeof(struct placement));
+    assert(NULL != search->first);
+    size_t len = 0;
+    for(int unshared = 2; unshared >= 0; unshared--) {
+        for(size_t i = 0; i < puzzle->len; i++) {
+            for(int o = 0; o < NUM_ORIENTATIONS; o++) {
+                const tile_t *tile = &puzzle->tiles[i];
+                int count =
+                    (edge_tile_count(index, oriented_edge(tile, o, 0)) == 1) +
+                    (edge_tile_count(index, oriented_edge(tile, o, 3)) == 1);
+                if(count == unshared) {
+                    search->first[len++] = (struct placement){i, 0, o};
+                }
+            }
+        }
+    }
+
+    for(int part = 0; part < search->workers; part++) {
+        pthread_mutex_init(&search->deques[part].lock, NULL);
+    }
+    push_search_task(search, 0, new_search_task(NULL, 0));
+    run_parallel(search_part, search, search->workers);
+
+    bool found = atomic_load(&search->found);
+    printf("Tried %zu placements on %d threads.\n",
+           (size_t)atomic_load(&search->tried), search->workers);
+    if(found) {
+        for(size_t depth = 0; depth < search->slots; depth++) {
+            struct placement placement = search->solution[depth];
+            size_t slot = placement.slot;
+            matrix->tiles[slot].source = &puzzle->tiles[placement.tile];
+            matrix->tiles[slot].rotation = placement.orientation % 4;
+            matrix->tiles[slot].flipped = placement.orientation >= 4;
+        }
+    }
+
+    for(int part = 0; part < search->workers; part++) {
+        struct task_deque *deque = &search->deques[part];
+        for(size_t i = deque->head; i < deque->tail; i++) {
+            free(deque->tasks[i]);
+        }
+        free(deque->tasks);
+        pthread_mutex_destroy(&deque->lock);
+    }
+    pthread_mutex_destroy(&search->solution_lock);
+    free(search->first);
+    free(search->solution);
+    free(search);
+    return found;
+}
+
+static image_t stitch_image(const puzzle_t *puzzle,
+                            const tilematrix_t *matrix) {
+    const int side = puzzle->side;
+    const int inner = side - 2;
+    const size_t tile_bytes = side * row_bytes(side);
+
+    image_t image;
+    image.side = matrix->side * inner;
+    image.pixels = calloc(image.side * image.side, sizeof(bool));
+    assert(NULL != image.pixels);
+
+    for(size_t position = 0; position < matrix->side * matrix->side;
+        position++) {
+        const uint8_t *stored =
+            &puzzle->rows[(matrix->tiles[position].source - puzzle->tiles) *
+                          tile_bytes];
+        tilerow_t rows[MAX_TILE_SIDE];
+        for(int r = 0; r < side; r++) {
+            rows[r] = load_row(stored, side, r);
+        }
+        orient_rows(rows, side,
+                    matrix->tiles[position].rotation +
+                        4 * matrix->tiles[position].flipped,
+                    rows);
+
+        size_t top = (position / matrix->side) * inner;
+        size_t left = (position % matrix->side) * inner;
+        for(int r = 0; r < inner; r++) {
+            bool *pixels = &image.pixels[(top + r) * image.side + left];
+            for(int c = 0; c < inner; c++) {
+                // skipping the border column on each side.
+                pixels[c] = (rows[r + 1] >> (inner - c)) & 1;
+            }
+        }
+    }
+
+    return image;
+}
+
+// Adds a pattern, given as rows of '#' and ' ', in all its distinct
+// orientations (flipped, then rotated clockwise, as with the tiles).
+static void add_pattern(patternset_t *set, const char *rows[]) {
+    if(set->len == MAX_PATTERNS) {
+        printf("Too many patterns! Exiting.\n");
+        exit(1);
+    }
+
+    static bool grid[MAX_PATTERN_SIDE][MAX_PATTERN_SIDE];
+    static bool next[MAX_PATTERN_SIDE][MAX_PATTERN_SIDE];
+    int height = 0, width = 0;
+    for(; NULL != rows[height]; height++) {
+        int len = strlen(rows[height]);
+        if(height == MAX_PATTERN_SIDE || len > MAX_PATTERN_SIDE) {
+            printf("Pattern is larger than %d cells! Exiting.\n",
+                   MAX_PATTERN_SIDE);
+            exit(1);
+        }
+        width = len > width ? len : width;
+    }
+    const int source_width = width, source_height = height;
+
+    for(int orientation = 0; orientation < NUM_ORIENTATIONS; orientation++) {
+        if(orientation % 4 == 0) {
+            width = source_width;
+            height = source_height;
+            memset(grid, 0, sizeof(grid));
+            for(int r = 0; r < height; r++) {
+                for(int c = 0; rows[r][c] != '\0'; c++) {
+                    int col = orientation == 0 ? c : width - 1 - c;
+                    grid[r][col] = rows[r][c] == '#';
+                }
+            }
+        } else {
+            // rotate clockwise.
+            for(int r = 0; r < width; r++) {
+                for(int c = 0; c < height; c++) {
+                    next[r][c] = grid[height - 1 - c][r];
+                }
+            }
+            memcpy(grid, next, sizeof(grid));
+            int temp = width;
+            width = height;
+            height = temp;
+        }
+
+        pattern_t pattern = {.width = width, .height = height};
+        for(int r = 0; r < height; r++) {
+            for(int c = 0; c < width; c++) {
+                pattern.rows[r] |= (uint64_t)grid[r][c] << c;
+            }
+        }
+
+        // symmetric patterns would otherwise be found more than once.
+        bool duplicate = false;
+        for(int i = 0; i < set->orientations[set->len]; i++) {
+            if(0 == memcmp(&set->oriented[set->len][i], &pattern,
+                           sizeof(pattern))) {
+                duplicate = true;
+            }
+        }
+        if(!duplicate) {
+            set->oriented[set->len][set->orientations[set->len]++] = pattern;
+        }
+    }
+    set->len++;
+}
+
+static void load_patterns(patternset_t *set, const char *path) {
+    FILE *input = fopen(path, "r");
+    if(NULL == input) {
+        printf("Couldn't open %s! Exiting.\n", path);
+        exit(1);
+    }
+
+    static char lines[MAX_PATTERN_SIDE + 1][MAX_PATTERN_SIDE + 2];
+    const char *rows[MAX_PATTERN_SIDE + 2];
+    int height = 0;
+    bool done = false;
+    while(!done) {
+        char *line = lines[height];
+        done = NULL == fgets(line, sizeof(lines[0]), input);
+        if(!done) {
+            line[strcspn(line, "\r\n")] = '\0';
+        }
+
+        if(done || line[0] == '\0') {
+            if(height > 0) {
+                rows[height] = NULL;
+                add_pattern(set, rows);
+                height = 0;
+            }
+        } else if(height == MAX_PATTERN_SIDE) {
+            printf("Pattern is larger than %d cells! Exiting.\n",
+                   MAX_PATTERN_SIDE);
+            exit(1);
+        } else {
+            rows[height] = line;
+            height++;
+        }
+    }
+
+    fclose(input);
+}
+
+static bitimage_t to_bitimage(const image_t *image) {
+    bitimage_t bitimage;
+    bitimage.side = image->side;
+    // one padding word for reads that straddle the end of the row, and one
+    // for reads that start past it.
+    bitimage.words = (image->side + 63) / 64 + 2;
+    bitimage.bits = calloc(image->side * bitimage.words, sizeof(uint64_t));
+    assert(NULL != bitimage.bits);
+
+    for(size_t row = 0; row < image->side; row++) {
+        for(size_t col = 0; col < image->side; col++) {
+            if(image->pixels[row * image->side + col]) {
+                bitimage.bits[row * bitimage.words + col / 64] |=
+                    (uint64_t)1 << (col % 64);
+            }
+        }
+    }
+
+    return bitimage;
+}
+
+// Returns the 64 bits of a row starting at column `start`.
+static uint64_t row_window(const bitimage_t *image, size_t row, size_t start) {
+    const uint64_t *words = &image->bits[row * image->words];
+    size_t word = start / 64, shift = start % 64;
+    if(shift == 0) {
+        return words[word];
+    }
+    return (words[word] >> shift) | (words[word + 1] << (64 - shift));
+}
+
+// Returns the offsets in [start, start + 64) where the pattern matches with
+// its top left corner on `row`, as a bitmask. Every set cell of the pattern
+// narrows all 64 candidate offsets down with a single AND.
+static uint64_t match_offsets(const bitimage_t *image, const pattern_t *pattern,
+                              size_t row, size_t start) {
+    uint64_t hits = ~(uint64_t)0;
+    for(int r = 0; r < pattern->height && hits != 0; r++) {
+        uint64_t cells = pattern->rows[r];
+        while(cells != 0 && hits != 0) {
+            int col = __builtin_ctzll(cells);
+            hits &= row_window(image, row + r, start + col);
+            cells &= cells - 1;
+        }
+    }
+
+    // offsets where the pattern would stick out of the image.
+    size_t limit = image->side - pattern->width + 1;
+    if(start + 64 > limit) {
+        hits &= limit > start ? ((uint64_t)1 << (limit - start)) - 1 : 0;
+    }
+    return hits;
+}
+
+static void mark_match(bitimage_t *covered, const pattern_t *pattern,
+                       size_t row, size_t col) {
+    size_t word = col / 64, shift = col % 64;
+    for(int r = 0; r < pattern->height; r++) {
+        uint64_t *words = &covered->bits[(row + r) * covered->words];
+        words[word] |= pattern->rows[r] << shift;
+        if(shift != 0) {
+            words[word + 1] |= pattern->rows[r] >> (64 - shift);
+        }
+    }
+}
+
+// Searches for every orientation of every pattern in one pass over the image,
+// printing the matches. Returns the number of set cells that aren't part of
+// any match.
+static size_t search_patterns(const bitimage_t *image,
+                              const patternset_t *set) {
+    bitimage_t covered = *image;
+    covered.bits = calloc(image->side * image->words, sizeof(uint64_t));
+    assert(NULL != covered.bits);
+
+    size_t matches[MAX_PATTERNS] = {0};
+    for(size_t row = 0; row < image->side; row++) {
+        for(size_t p = 0; p < set->len; p++) {
+            for(int o = 0; o < set->orientations[p]; o++) {
+                const pattern_t *pattern = &set->oriented[p][o];
+                if(pattern->height > image->side - row ||
+                   pattern->width > image->side) {
+                    continue;
+                }
+
+                for(size_t start = 0; start < image->side; start += 64) {
+                    uint64_t hits = match_offsets(image, pattern, row, start);
+                    while(hits != 0) {
+                        size_t col = start + __builtin_ctzll(hits);
+                        printf("Pattern %zu (orientation %d) at row %zu, "
+                               "column %zu.\n",
+                               p, o, row, col);
+                        mark_match(&covered, pattern, row, col);
+                        matches[p]++;
+                        hits &= hits - 1;
+                    }
+                }
+            }
+        }
+    }
+
+    for(size_t p = 0; p < set->len; p++) {
+        printf("Pattern %zu: %zu matches.\n", p, matches[p]);
+    }
+
+    size_t roughness = 0;
+    for(size_t i = 0; i < image->side * image->words; i++) {
+        roughness += __builtin_popcountll(image->bits[i] & ~covered.bits[i]);
+    }
+
+    free(covered.bits);
+    return roughness;
+}
+
+// Uses a thread per core, but no more than one for every min_part_size items.
+// DAY20_THREADS overrides the number of cores.
+static int count_workers(size_t size, size_t min_part_size) {
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    const char *threads = getenv("DAY20_THREADS");
+    if(NULL != threads) {
+        cores = atol(threads);
+    }
+
+    size_t workers = size / min_part_size + 1;
+    if(workers > (size_t)cores) {
+        workers = cores;
+    }
+    if(workers > MAX_WORKERS) {
+        workers = MAX_WORKERS;
+    }
+    return workers < 1 ? 1 : workers;
+}
+
+struct task_part {
+    task_t task;
+    void *context;
+    int part, parts;
+};
+
+static void *run_task_part(void *arg) {
+    struct task_part *part = arg;
+    part->task(part->context, part->part, part->parts);
+    return NULL;
+}
+
+static void run_parallel(task_t task, void *context, int parts) {
+    pthread_t threads[MAX_WORKERS];
+    struct task_part args[MAX_WORKERS];
+    for(int part = 1; part < parts; part++) {
+        args[part] = (struct task_part){task, context, part, parts};
+        if(0 != pthread_create(&threads[part], NULL, run_task_part,
+                               &args[part])) {
+            printf("Couldn't start a thread! Exiting.\n");
+            exit(1);
+        }
+    }
+
+    task(context, 0, parts);
+    for(int part = 1; part < parts; part++) {
+        pthread_join(threads[part], NULL);
+    }
+}
+
+static void free_edge_index(edge_index_t *index) {
+    free(index->offsets);
+    free(index->tile_ids);
+    free(index->codes);
+}